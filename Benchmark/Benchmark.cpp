@@ -0,0 +1,1364 @@
+/*
+*  Subject: Benchmark
+*  Purpose: Throughput of encoder and DSP stages with pass/fail thresholds. Exit code is 1 if any stage failed.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "POCSAG.h"
+#include "POCSAG_Internal.h"
+#include "POCSAG_Batch.h"
+#include "HackRF_PCMSource.h"
+#include "HackRF_Modulator.h"
+#include "HackRF_Resampler.h"
+#include "HackRF_TxRing.h"
+#include "HackRF_VirtualDevice.h"
+#include "HackRFTransmitter.h"
+#include "HackRF_StreamSource.h"
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <bitset>
+#include <fstream>
+#include <filesystem>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+//Must be built with optimizations, thresholds are for Release build.
+//Usage: Benchmark [stage name filter]
+
+constexpr double PI					= 3.14159265358979323846;
+constexpr double STAGE_SECONDS		= 0.3;		//Minimal run time of each measurement
+constexpr double DEVICE_MAX_RATE	= 20.0;		//Msamples/s, every per-sample DSP stage must keep up with it
+constexpr uint32_t AUDIO_RATE		= 48000;
+constexpr uint32_t DEVICE_RATE		= 2000000;
+constexpr double MIN_DEVICE_RATE	= 2.0;		//MHz, the lowest rate of HackRF
+
+//Access to private stages of encoder and PCM source
+class HackRF_Benchmark
+{
+public:
+	template<typename T>
+	static void ModulatePOCSAG(POCSAG::Encoder& encoder, std::vector<T>& output, const std::vector<uint8_t>& data, uint16_t bps, T high, T low)
+	{
+		encoder._modulatePOCSAG(output, data, bps, high, low);
+	}
+
+	template<typename T>
+	static size_t ModulatePOCSAG(const POCSAG::Encoder& encoder, T* output, const std::vector<uint8_t>& data, uint16_t bps, T high, T low)
+	{
+		return encoder._modulatePOCSAG(output, data.data(), data.size(), bps, encoder.GetSampleRate(POCSAG::BPS(bps)), high, low);
+	}
+
+	static void MakeBuffer(HackRF_PCMSource& source, const std::vector<uint8_t>& wave)
+	{
+		source._makeBuffer(wave);
+	}
+};
+
+//Counts I/Q pairs of transmitted subchunks. Silence, which device gets while worker is behind, is zero and isn't counted.
+class HackRF_CarrierCounter : public HackRF_NullDevice
+{
+private:
+	std::atomic<uint64_t> m_carrier{ 0 };
+	std::atomic<double> m_carrierSeconds{ 0 };	//At device rate of every transfer
+
+protected:
+	void onTransfer(const int8_t* buffer, uint32_t length) override
+	{
+		uint64_t carrier = 0;
+		for (uint32_t i = 0; i + 1 < length; i += 2)
+			carrier += (buffer[i] | buffer[i + 1]) != 0 ? 1 : 0;
+		m_carrier += carrier;
+		m_carrierSeconds = m_carrierSeconds + double(carrier) / GetSampleRate();
+	}
+
+public:
+	using HackRF_NullDevice::HackRF_NullDevice;
+
+	uint64_t GetCarrierSamples() const { return m_carrier; }
+	double GetCarrierSeconds() const { return m_carrierSeconds; }
+};
+
+struct Result
+{
+	std::string stage;
+	double value;
+	std::string unit;
+	double limit;		//NAN if stage is informational
+	bool lowerIsBetter;
+
+	bool Passed() const { return std::isnan(limit) || (lowerIsBetter ? value <= limit : value >= limit); }
+};
+
+static std::vector<Result> results;
+static std::string filter;
+
+static bool enabled(const std::string& stage)
+{
+	return filter.empty() || stage.find(filter) != std::string::npos;
+}
+
+static void report(const std::string& stage, double value, const std::string& unit, double limit = NAN, bool lowerIsBetter = false)
+{
+	Result r = { stage, value, unit, limit, lowerIsBetter };
+	results.push_back(r);
+
+	std::cout << std::left << std::setw(34) << stage << std::right << std::setw(14) << std::fixed << std::setprecision(2) << value << " " << std::left << std::setw(12) << unit;
+	if (!std::isnan(limit))
+		std::cout << (lowerIsBetter ? "<= " : ">= ") << std::setw(10) << limit << (r.Passed() ? "PASS" : "FAIL");
+	std::cout << std::endl;
+}
+
+//Runs func until STAGE_SECONDS passed, returns calls per second
+static double measure(const std::function<void()>& func)
+{
+	using namespace std::chrono;
+	func(); //Warm up caches and lazy tables
+
+	size_t calls = 0;
+	auto start = steady_clock::now();
+	duration<double> elapsed(0);
+	while (elapsed.count() < STAGE_SECONDS)
+	{
+		func();
+		calls++;
+		elapsed = steady_clock::now() - start;
+	}
+
+	return calls / elapsed.count();
+}
+
+static volatile uint32_t sink; //Keeps results alive
+
+//Every heap allocation of the process is counted, so stages which must not allocate can be checked
+static std::atomic<size_t> allocations{ 0 };
+
+//All forms are replaced and go through one pair of functions, so every delete matches its new
+static void* countedAlloc(size_t size, size_t alignment = 0) noexcept
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	size = size ? size : 1;
+	if (alignment <= alignof(std::max_align_t))
+		return std::malloc(size);
+#ifdef _WIN32
+	return _aligned_malloc(size, alignment);
+#else
+	void* ptr = nullptr;
+	return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+#endif
+}
+
+static void countedFree(void* ptr, size_t alignment = 0) noexcept
+{
+#ifdef _WIN32
+	if (alignment > alignof(std::max_align_t))
+	{
+		_aligned_free(ptr);
+		return;
+	}
+#endif
+	(void)alignment;
+	std::free(ptr);
+}
+
+static void* countedNew(size_t size, size_t alignment = 0)
+{
+	if (void* ptr = countedAlloc(size, alignment))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return countedNew(size); }
+void* operator new[](size_t size) { return countedNew(size); }
+void* operator new(size_t size, std::align_val_t al) { return countedNew(size, size_t(al)); }
+void* operator new[](size_t size, std::align_val_t al) { return countedNew(size, size_t(al)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return countedAlloc(size, size_t(al)); }
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return countedAlloc(size, size_t(al)); }
+
+void operator delete(void* ptr) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr) noexcept { countedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t al) noexcept { countedFree(ptr, size_t(al)); }
+void operator delete[](void* ptr, std::align_val_t al) noexcept { countedFree(ptr, size_t(al)); }
+void operator delete(void* ptr, size_t, std::align_val_t al) noexcept { countedFree(ptr, size_t(al)); }
+void operator delete[](void* ptr, size_t, std::align_val_t al) noexcept { countedFree(ptr, size_t(al)); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { countedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { countedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t al, const std::nothrow_t&) noexcept { countedFree(ptr, size_t(al)); }
+void operator delete[](void* ptr, std::align_val_t al, const std::nothrow_t&) noexcept { countedFree(ptr, size_t(al)); }
+
+static std::vector<float> makeTone(double hz, uint32_t rate, size_t count, float amplitude)
+{
+	std::vector<float> tone(count);
+	for (size_t i = 0; i < count; i++)
+		tone[i] = amplitude * (float)sin(2.0 * PI * hz * i / rate);
+	return tone;
+}
+
+//Power of frequency in signal, Goertzel
+static double power(const std::vector<float>& signal, size_t first, double hz, uint32_t rate)
+{
+	double coeff = 2.0 * cos(2.0 * PI * hz / rate);
+	double s1 = 0, s2 = 0;
+	for (size_t i = first; i < signal.size(); i++)
+	{
+		double s = signal[i] + coeff * s1 - s2;
+		s2 = s1;
+		s1 = s;
+	}
+	return s1 * s1 + s2 * s2 - coeff * s1 * s2;
+}
+
+static std::vector<uint8_t> makeWave(double seconds)
+{
+	std::vector<int16_t> pcm;
+	for (float sample : makeTone(1200.0, AUDIO_RATE, size_t(AUDIO_RATE * seconds), 0.8f))
+		pcm.push_back(int16_t(sample * 32767));
+	std::vector<uint8_t> wave;
+	POCSAG::MakePCM(pcm, wave, AUDIO_RATE);
+	return wave;
+}
+
+static std::string writeTempFile(const std::string& name, const std::vector<uint8_t>& data)
+{
+	std::string fileName = (std::filesystem::temp_directory_path() / name).string();
+	std::ofstream file(fileName, std::ios::binary);
+	file.write((const char*)data.data(), data.size());
+	if (!file)
+		throw std::runtime_error("Cannot write " + fileName);
+	return fileName;
+}
+
+/*
+*  Reference implementations of replaced stages
+*/
+
+//Former HackRFTransmitter::_interpolation: stretches subchunk of inCount samples to outCount samples
+struct LegacyInterpolator
+{
+	float last[4] = {};
+
+	void Run(const float* in_buf, size_t sampleCount, float* out, uint32_t bufLen)
+	{
+		size_t i;
+		uint32_t j = 0;
+		float pos = (float)sampleCount / (float)bufLen;
+		while (pos < 1.0)
+		{
+			out[j] = last[3] + (in_buf[0] - last[3]) * pos;
+			j++;
+			pos = (float)(j + 1) * (float)sampleCount / (float)bufLen;
+		}
+
+		i = (uint32_t)pos;
+		while (j < (bufLen - 1))
+		{
+			out[j] = in_buf[i - 1] + (in_buf[i] - in_buf[i - 1]) * (pos - (float)i);
+			j++;
+			pos = (float)(j + 1) * (float)sampleCount / (float)bufLen;
+			i = (uint32_t)pos;
+		}
+
+		out[j] = in_buf[sampleCount - 1];
+		for (i = sampleCount - 4, j = 0; j < 4; i++, j++)
+			last[j] = in_buf[i];
+	}
+};
+
+//Former POCSAG::SignFrame: bit by bit BCH division and parity
+static uint32_t referenceSignFrame(uint32_t in)
+{
+	uint32_t cw = in, newCw = in, parity = 0;
+
+	for (int bit = 1; bit <= 21; bit++, cw <<= 1)
+	{
+		if (cw & 0x80000000)
+			cw ^= 0xED200000;
+	}
+
+	newCw |= (cw >> 21);
+	cw = newCw;
+	for (int bit = 1; bit <= 32; bit++, cw <<= 1)
+	{
+		if (cw & 0x80000000)
+			parity++;
+	}
+
+	if (parity % 2)
+		newCw++;
+
+	return newCw;
+}
+
+//Former POCSAG::EncodeMessageNumeric and EncodeMessageAlphanumeric: one bitset per character with reversed bit order
+template<size_t N>
+static std::vector<std::bitset<N>> referenceMessageBits(const std::string& msg)
+{
+	auto reverse = [](uint32_t c)
+	{
+		uint32_t result = 0;
+		for (size_t i = 0; i < N; i++)
+			result = (result << 1) | ((c >> i) & 1);
+		return result;
+	};
+
+	std::vector<std::bitset<N>> bits;
+	for (char c : msg)
+	{
+		if (N == 4)
+		{
+			if (c == 0 || c == '\r')
+				break;
+			static const std::string symbols = "0123456789*U -)(";
+			c = c == 'u' ? 'U' : c == '\n' ? ' ' : c == ']' ? ')' : c == '[' ? '(' : c;
+			bits.push_back(reverse((uint32_t)symbols.find(c)));
+		}
+		else
+			bits.push_back(reverse(uint8_t(c)));
+	}
+
+	if (N == 7 && !bits.empty() && bits.back().to_ulong() != 0)
+		bits.push_back(0);
+	return bits;
+}
+
+//Former POCSAG::MakeMessageCodeword: codeword collected bit by bit, cell of every bit found with division
+template<size_t N>
+static void referencePageCodewords(std::vector<uint32_t>& cws, const std::string& msg)
+{
+	auto bits = referenceMessageBits<N>(msg);
+	size_t maxBits = bits.size() * N, offset = 0;
+	cws.clear();
+	while (offset < maxBits)
+	{
+		uint32_t cw = 0;
+		size_t counter = 0;
+		for (size_t i = offset / N, j = offset % N; i < bits.size() && counter < 20; i++, j = 0)
+		{
+			for (; j < N && counter < 20; j++, counter++)
+				cw = (cw << 1) | (bits[i][N - 1 - j] ? 1 : 0);
+		}
+
+		if (N == 4)
+		{
+			for (size_t rest = counter; rest < 20; rest += N)
+				cw = (cw << 4) | 0x3; //Spaces
+		}
+		else
+			cw <<= 20 - counter; //Zeroes
+
+		offset += counter;
+		cws.push_back(referenceSignFrame((cw << 11) | 0x80000000));
+	}
+}
+
+//Former POCSAG::Encoder::_modulatePOCSAG: samples of every bit inserted separately, bit is truncated to whole samples
+template<typename T>
+static void referenceModulate(std::vector<T>& output, const std::vector<uint8_t>& data, uint32_t sampleRate, uint16_t bps, T high, T low)
+{
+	uint32_t samplesPerBit = sampleRate / bps;
+	output.reserve(output.size() + (sampleRate / 2) * 2 + data.size() * 8 * samplesPerBit);
+	output.insert(output.end(), sampleRate / 2, T(0));
+
+	for (size_t i = 0; i < 72; i++)
+	{
+		for (size_t j = 0; j < 8; j++)
+			output.insert(output.end(), samplesPerBit, ((data[i] >> (7 - j)) & 1) ? high : low);
+	}
+
+	for (size_t i = 72; i < data.size(); i += 4)
+	{
+		uint32_t cw = *reinterpret_cast<const uint32_t*>(&data[i]);
+		for (size_t j = 0; j < 32; j++)
+			output.insert(output.end(), samplesPerBit, ((cw >> (31 - j)) & 1) ? high : low);
+	}
+
+	output.insert(output.end(), sampleRate / 2, T(0));
+}
+
+//Former wavRead32FromMemory of HackRF_PCMSource: sample by sample through int16, 8 bit taken as signed
+static void referenceDecode(const unsigned char* in, size_t inSize, uint16_t channels, float* out, size_t sampleCount, uint16_t byterate)
+{
+	unsigned char bufi[8];
+	size_t off = 0;
+	auto readNext = [&in, &bufi, &off, &inSize](size_t itemSize, size_t count)
+	{
+		size_t i = 0;
+		for (i = 0; i < count * itemSize && i + off < inSize; i++)
+			bufi[i] = in[i + off];
+		off += i;
+
+		return i / itemSize;
+	};
+
+	int16_t i16 = 0;
+	int32_t i32;
+	auto makeSample = [&]()
+	{
+		switch (byterate)
+		{
+		case 1:
+			i16 = ((int8_t*)bufi)[0] * int16_t(32767 / 255);
+			break;
+
+		case 2:
+			memcpy(&i16, bufi, 2);
+			break;
+
+		case 3:
+			i32 = bufi[0] | (bufi[1] << 8) | (bufi[2] << 16);
+			if (i32 & 0x800000)
+				i32 |= 0x80000000;
+			i16 = int16_t(i32 / (8388607 / 32767));
+			break;
+
+		case 4:
+			memcpy(&i32, bufi, 4);
+			i16 = int16_t(i32 / (2147483647 / 32767));
+			break;
+		}
+	};
+
+	for (size_t i = 0; i < sampleCount; i += channels)
+	{
+		if (readNext(byterate, 1) != 1)
+			break;
+
+		makeSample();
+		if (channels > 1)
+		{
+			if (readNext(byterate, 1) != 1)
+				break;
+
+			float fs1 = (float)i16 / 65530;
+			makeSample();
+			float fs2 = (float)i16 / 65530;
+			out[i / channels] = ((fs1 + fs2) / 2.0f);
+		}
+		else
+			out[i] = ((float)i16 / 65530);
+	}
+}
+
+//Former HackRF_PCMSource file constructor: whole file is read into temporary buffer first
+static std::vector<uint8_t> referenceReadFile(const std::string& fileName)
+{
+	std::vector<uint8_t> buf;
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (!file)
+		throw std::runtime_error("Cannot open " + fileName);
+	fseek(file, 0L, SEEK_END);
+	buf.resize(ftell(file));
+	rewind(file);
+	size_t read = fread(buf.data(), buf.size(), 1, file);
+	fclose(file);
+	if (read != 1)
+		throw std::runtime_error("Cannot read " + fileName);
+	return buf;
+}
+
+//Former HackRFTransmitter::_modulation FM branch with int8 conversion
+static void referenceFM(const float* audio, size_t count, float gain, double deviationHz, double sampleRate, double& phase, int8_t* iq)
+{
+	double fm_deviation = 2.0 * PI * deviationHz / sampleRate;
+	for (size_t i = 0; i < count; i++)
+	{
+		double audio_amp = audio[i] * gain;
+		if (fabs(audio_amp) > 1.0)
+			audio_amp = (audio_amp > 0.0) ? 1.0 : -1.0;
+
+		phase += fm_deviation * audio_amp;
+		while (phase > PI)
+			phase -= 2.0 * PI;
+		while (phase < -PI)
+			phase += 2.0 * PI;
+
+		iq[i * 2] = (int8_t)lrint(sin(phase) * 127.0);
+		iq[i * 2 + 1] = (int8_t)lrint(cos(phase) * 127.0);
+	}
+}
+
+/*
+*  Encoder stages
+*/
+
+static void benchEncoder()
+{
+	using namespace POCSAG;
+	const std::string latin = "The quick brown fox jumps over the lazy dog. 0123456789 Pack my box with five dozen liquor jugs.";
+	const std::string cyrillic = "Съешь же ещё этих мягких французских булок, да выпей чаю. Широкая электрификация южных губерний.";
+	const std::string numeric = "0123456789 -[]U0123456789 -[]U0123456789";
+
+	if (enabled("SignFrame"))
+	{
+		std::vector<uint32_t> frames(4096);
+		std::mt19937 rng(1);
+		for (auto& f : frames)
+			f = rng() & 0xFFFFF800;
+
+		double rate = measure([&]()
+		{
+			uint32_t acc = 0;
+			for (auto f : frames)
+				acc ^= SignFrame(f);
+			sink = acc;
+		});
+		report("SignFrame", rate * frames.size() / 1e6, "Mcw/s", 100.0);
+
+		rate = measure([&]()
+		{
+			uint32_t acc = 0;
+			for (auto f : frames)
+				acc ^= referenceSignFrame(f);
+			sink = acc;
+		});
+		report("SignFrame legacy", rate * frames.size() / 1e6, "Mcw/s");
+
+		//Every data word, then random words with garbage in check bits
+		size_t mismatches = 0;
+		for (uint32_t data = 0; data < (1u << 21); data++)
+			mismatches += SignFrame(data << 11) != referenceSignFrame(data << 11) ? 1 : 0;
+		for (size_t i = 0; i < (1u << 22); i++)
+		{
+			uint32_t word = rng();
+			mismatches += SignFrame(word) != referenceSignFrame(word) ? 1 : 0;
+		}
+		for (uint32_t ric = 0; ric < (1u << 21); ric++)
+		{
+			for (uint32_t func = 0; func < 4; func++)
+				mismatches += MakeAddressCodeword(ric, (Function)func) != referenceSignFrame(((ric >> 3) << 13) | (func << 11)) ? 1 : 0;
+		}
+		report("SignFrame mismatches", (double)mismatches, "", 0.0, true);
+
+		std::vector<uint32_t> rics(4096);
+		for (auto& ric : rics)
+			ric = 1000000 + rng() % 5000;
+		rate = measure([&]()
+		{
+			uint32_t acc = 0;
+			for (auto ric : rics)
+				acc ^= MakeAddressCodeword(ric, Function::A);
+			sink = acc;
+		});
+		report("MakeAddressCodeword", rate * rics.size() / 1e6, "Mcw/s", 20.0);
+	}
+
+	if (enabled("MakeMessageCodeword"))
+	{
+		std::vector<uint32_t> cws;
+		MakePageCodewords(cws, latin, Type::Alphanumeric);
+		size_t alphaCws = cws.size();
+		double rate = measure([&]() { MakePageCodewords(cws, latin, Type::Alphanumeric); });
+		report("MakeMessageCodeword alpha", rate * alphaCws / 1e6, "Mcw/s", 10.0);
+
+		rate = measure([&]() { referencePageCodewords<7>(cws, latin); });
+		report("MakeMessageCodeword alpha legacy", rate * alphaCws / 1e6, "Mcw/s");
+
+		MakePageCodewords(cws, numeric, Type::Numeric);
+		size_t numCws = cws.size();
+		rate = measure([&]() { MakePageCodewords(cws, numeric, Type::Numeric); });
+		report("MakeMessageCodeword numeric", rate * numCws / 1e6, "Mcw/s", 10.0);
+
+		rate = measure([&]() { referencePageCodewords<4>(cws, numeric); });
+		report("MakeMessageCodeword numeric legacy", rate * numCws / 1e6, "Mcw/s");
+
+		//Every length up to a few batches, so the last codeword is cut at every position of a character
+		std::mt19937 rng(2);
+		const std::string digits = "0123456789*Uu -()[]\n";
+		size_t mismatches = 0;
+		std::vector<uint32_t> expected;
+		for (size_t len = 0; len < 400; len++)
+		{
+			std::string alpha, num;
+			for (size_t i = 0; i < len; i++)
+			{
+				alpha.push_back(char(rng() % 128));
+				num.push_back(digits[rng() % digits.size()]);
+			}
+
+			MakePageCodewords(cws, alpha, Type::Alphanumeric);
+			referencePageCodewords<7>(expected, alpha);
+			mismatches += cws != expected ? 1 : 0;
+
+			MakePageCodewords(cws, num, Type::Numeric);
+			referencePageCodewords<4>(expected, num);
+			mismatches += cws != expected ? 1 : 0;
+		}
+		report("MakeMessageCodeword mismatches", (double)mismatches, "", 0.0, true);
+	}
+
+	if (enabled("encodeString7bit"))
+	{
+		double rate = measure([&]() { sink = (uint32_t)encodeString7bit(latin, Charset::Latin).size(); });
+		report("encodeString7bit Latin", rate, "pages/s", 100000);
+
+		rate = measure([&]() { sink = (uint32_t)encodeString7bit(cyrillic, Charset::Cyrilic).size(); });
+		report("encodeString7bit Cyrillic", rate, "pages/s", 20000);
+	}
+
+	Encoder encoder;
+	std::vector<uint8_t> raw;
+	encoder.encode(raw, 1234567, Type::Alphanumeric, latin, BPS::BPS_1200, Charset::Latin, Function::A, true);
+
+	if (enabled("encode"))
+	{
+		double rate = measure([&]() { encoder.encode(raw, 1234567, Type::Alphanumeric, latin, BPS::BPS_1200, Charset::Latin, Function::A, true); });
+		report("encode raw single page", rate, "pages/s", 20000);
+
+		std::vector<Page> pages;
+		for (uint32_t i = 0; i < 40; i++)
+			pages.push_back({ 1000000 + i * 37, i % 3 ? Type::Alphanumeric : Type::Numeric, i % 3 ? latin.substr(0, 20 + i) : numeric.substr(0, 10 + i / 4) });
+
+		std::vector<uint8_t> multi;
+		rate = measure([&]() { encoder.encode(multi, pages, BPS::BPS_1200, true); });
+		report("encode raw 40 pages", rate * pages.size(), "pages/s", 20000);
+
+		//Steady state of gateway worker: workspace of encoder and output buffers have grown on the first call
+		std::vector<float> samples;
+		std::vector<uint8_t> wave;
+		Page cyrillicPage{ 1234567, Type::Alphanumeric, cyrillic, Charset::Cyrilic, Function::C };
+		auto encodeAll = [&]()
+		{
+			multi.resize(encoder.prepare(pages, BPS::BPS_1200, Output::Raw));
+			encoder.encodeInto(std::span<uint8_t>(multi));
+			samples.resize(encoder.prepare(pages, BPS::BPS_512, Output::Samples));
+			encoder.encodeInto(std::span<float>(samples));
+			wave.resize(encoder.prepare(cyrillicPage, BPS::BPS_2400, Output::Wave));
+			encoder.encodeInto(std::span<uint8_t>(wave));
+		};
+
+		encoder.SetDateTimePosition(DateTimePosition::End);
+		encodeAll();
+		size_t before = allocations.load();
+		for (int i = 0; i < 10; i++)
+			encodeAll();
+		report("encodeInto allocations", double(allocations.load() - before), "", 0.0, true);
+		encoder.SetDateTimePosition(DateTimePosition::None);
+
+		std::vector<uint8_t> expected;
+		encoder.encode(expected, pages, BPS::BPS_1200, true);
+		multi.assign(encoder.prepare(pages, BPS::BPS_1200, Output::Raw), 0);
+		encoder.encodeInto(std::span<uint8_t>(multi));
+		report("encodeInto mismatches", multi != expected ? 1.0 : 0.0, "", 0.0, true);
+
+		rate = measure([&]()
+		{
+			multi.resize(encoder.prepare(pages, BPS::BPS_1200, Output::Raw));
+			encoder.encodeInto(std::span<uint8_t>(multi));
+		});
+		report("encodeInto raw 40 pages", rate * pages.size(), "pages/s", 20000);
+	}
+
+	if (enabled("_modulatePOCSAG"))
+	{
+		std::vector<float> samples;
+		HackRF_Benchmark::ModulatePOCSAG(encoder, samples, raw, 1200, 0.1f, -0.1f);
+		size_t count = samples.size();
+		//Into buffer of known size, as encodeInto() does
+		double rate = measure([&]() { sink = (uint32_t)HackRF_Benchmark::ModulatePOCSAG(encoder, samples.data(), raw, 1200, 0.1f, -0.1f); });
+		report("_modulatePOCSAG float", rate * count / 1e6, "Msamples/s", 50.0);
+
+		std::vector<Encoder::PCMSample_t> pcm(count);
+		rate = measure([&]() { sink = (uint32_t)HackRF_Benchmark::ModulatePOCSAG<Encoder::PCMSample_t>(encoder, pcm.data(), raw, 1200, 5000, -5000); });
+		report("_modulatePOCSAG int16", rate * count / 1e6, "Msamples/s", 50.0);
+
+		//Old per-bit loop for comparison. Both are memory bound here and run at the same speed
+		//within run-to-run noise, the gain of the new loop is exact bit timing checked below
+		std::vector<float> legacy;
+		rate = measure([&]() { legacy.clear(); referenceModulate(legacy, raw, encoder.GetSampleRate(), 1200, 0.1f, -0.1f); });
+		report("_modulatePOCSAG float legacy", rate * count / 1e6, "Msamples/s");
+
+		std::vector<Encoder::PCMSample_t> legacyPcm;
+		rate = measure([&]() { legacyPcm.clear(); referenceModulate<Encoder::PCMSample_t>(legacyPcm, raw, encoder.GetSampleRate(), 1200, 5000, -5000); });
+		report("_modulatePOCSAG int16 legacy", rate * count / 1e6, "Msamples/s");
+
+		//At 512 bps bit is 86.13 samples long, truncation to 86 used to shift every next bit by 0.13 sample more
+		const uint32_t sampleRate = encoder.GetSampleRate();
+		const size_t silence = sampleRate / 2, bits = raw.size() * 8;
+		const double samplesPerBit = double(sampleRate) / 512.0;
+		auto bitAt = [&raw](size_t k)
+		{
+			if (k < 72 * 8)
+				return (raw[k / 8] >> (7 - k % 8)) & 1;
+			uint32_t cw = *reinterpret_cast<const uint32_t*>(&raw[72 + (k - 72 * 8) / 32 * 4]);
+			return int(cw >> (31 - (k - 72 * 8) % 32)) & 1;
+		};
+
+		samples.clear();
+		HackRF_Benchmark::ModulatePOCSAG(encoder, samples, raw, 512, 1.0f, -1.0f);
+		size_t bitErrors = 0;
+		for (size_t k = 0; k < bits; k++)
+			bitErrors += (samples[silence + size_t((k + 0.5) * samplesPerBit)] > 0.0f) != (bitAt(k) == 1) ? 1 : 0;
+		report("_modulatePOCSAG length error", fabs(double(samples.size() - 2 * silence) - bits * samplesPerBit), "samples", 1.0, true);
+		report("_modulatePOCSAG bit errors", (double)bitErrors, "", 0.0, true);
+
+		samples.clear();
+		referenceModulate(samples, raw, sampleRate, 512, 1.0f, -1.0f);
+		report("_modulatePOCSAG legacy length error", fabs(double(samples.size() - 2 * silence) - bits * samplesPerBit), "samples");
+	}
+
+	if (enabled("Minimum sample rate"))
+	{
+		//4 samples per bit instead of 44100 Hz: 4800 Hz at 1200 bps
+		Encoder minimal(8, encoder.GetSampleRate(), 4);
+		std::vector<Page> pages;
+		for (uint32_t i = 0; i < 16; i++)
+			pages.push_back({ 1000000 + i, Type::Alphanumeric, latin });
+
+		std::vector<float> full, reduced;
+		encoder.encodeSamples(full, pages, BPS::BPS_1200);
+		minimal.encodeSamples(reduced, pages, BPS::BPS_1200);
+		report("Minimum sample rate size reduction", double(full.size()) / double(reduced.size()), "x", 5.0);
+
+		double rate = measure([&]() { full.resize(encoder.prepare(pages, BPS::BPS_1200, Output::Samples)); encoder.encodeInto(std::span<float>(full)); });
+		report("encodeInto samples 16 pages at 44100 Hz", rate * pages.size(), "pages/s");
+		rate = measure([&]() { reduced.resize(minimal.prepare(pages, BPS::BPS_1200, Output::Samples)); minimal.encodeInto(std::span<float>(reduced)); });
+		report("encodeInto samples 16 pages at minimum rate", rate * pages.size(), "pages/s");
+
+		//Every bit is exactly 4 samples, all of them must have value of bit
+		std::vector<uint8_t> raw1200;
+		minimal.encode(raw1200, pages, BPS::BPS_1200, true);
+		const size_t silence = minimal.GetSampleRate(BPS::BPS_1200) / 2;
+		size_t bitErrors = reduced.size() == 2 * silence + raw1200.size() * 8 * 4 ? 0 : 1;
+		for (size_t k = 0; k < raw1200.size() * 8 && bitErrors == 0; k++)
+		{
+			bool one = k < 72 * 8
+				? ((raw1200[k / 8] >> (7 - k % 8)) & 1) != 0
+				: ((*reinterpret_cast<const uint32_t*>(&raw1200[72 + (k - 72 * 8) / 32 * 4]) >> (31 - (k - 72 * 8) % 32)) & 1) != 0;
+			for (size_t j = 0; j < 4; j++)
+				bitErrors += (reduced[silence + k * 4 + j] > 0.0f) != one ? 1 : 0;
+		}
+		report("Minimum sample rate bit errors", (double)bitErrors, "", 0.0, true);
+
+		std::vector<uint8_t> wave;
+		minimal.encode(wave, pages, BPS::BPS_2400);
+		HackRF_PCMSource source(wave);
+		report("Minimum sample rate WAV header error", fabs(double(source.GetSamplingRate()) - 9600.0), "Hz", 0.0, true);
+	}
+
+	if (enabled("MakePCM"))
+	{
+		std::vector<Encoder::PCMSample_t> pcm;
+		HackRF_Benchmark::ModulatePOCSAG<Encoder::PCMSample_t>(encoder, pcm, raw, 1200, 5000, -5000);
+		std::vector<uint8_t> wave;
+		double rate = measure([&]() { MakePCM(pcm, wave, encoder.GetSampleRate()); });
+		report("MakePCM", rate * pcm.size() / 1e6, "Msamples/s", 20.0);
+
+		HackRF_PCMSource source(std::vector<float>(), 0);
+		rate = measure([&]() { HackRF_Benchmark::MakeBuffer(source, wave); });
+		report("HackRF_PCMSource::_makeBuffer", rate * pcm.size() / 1e6, "Msamples/s", 20.0);
+	}
+}
+
+static void benchBatch()
+{
+	using namespace POCSAG;
+	if (!enabled("BatchEncoder"))
+		return;
+
+	//Backlog after outage: many short transmissions of one to four pages
+	const std::string latin = "The quick brown fox jumps over the lazy dog. 0123456789 Pack my box with five dozen liquor jugs.";
+	std::mt19937 rng(3);
+	std::vector<Transmission> backlog(2000);
+	size_t pageCount = 0;
+	for (auto& tx : backlog)
+	{
+		size_t pages = 1 + rng() % 4;
+		for (size_t i = 0; i < pages; i++)
+			tx.pages.push_back({ 1000000 + rng() % 100000, Type::Alphanumeric, latin.substr(0, 10 + rng() % 80) });
+		tx.bps = BPS::BPS_1200;
+		pageCount += pages;
+	}
+	backlog[7].pages[0].address = 3000000; //Must fail alone
+
+	Encoder encoder;
+	std::vector<EncodedTransmission> expected(backlog.size());
+	for (size_t i = 0; i < backlog.size(); i++)
+	{
+		try
+		{
+			expected[i].result = encoder.encode(expected[i].bytes, backlog[i].pages, backlog[i].bps, true);
+		}
+		catch (const std::exception& ex)
+		{
+			expected[i].error = ex.what();
+		}
+	}
+
+	//Scaling by thread count, results must be the same as of sequential encode() whatever thread did them
+	const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+	size_t mismatches = 0;
+	double single = 0, best = 0;
+	for (size_t threads = 1; threads <= std::max<size_t>(cores, 4); threads *= 2)
+	{
+		BatchEncoder batch(encoder, threads);
+		std::vector<EncodedTransmission> results;
+		batch.encode(backlog, Output::Raw, results);
+		for (size_t i = 0; i < backlog.size(); i++)
+			mismatches += (results[i].bytes != expected[i].bytes || results[i].error != expected[i].error) ? 1 : 0;
+
+		double rate = measure([&]() { batch.encode(backlog, Output::Raw, results); });
+		report("BatchEncoder " + std::to_string(threads) + " threads", rate * pageCount, "pages/s", threads == 1 ? 200000.0 : NAN);
+		single = threads == 1 ? rate : single;
+		best = std::max(best, rate);
+	}
+	report("BatchEncoder mismatches", (double)mismatches, "", 0.0, true);
+	report("BatchEncoder CPU threads", (double)cores, "");
+	report("BatchEncoder best speedup", best / single, "x");
+}
+
+/*
+*  DSP stages
+*/
+
+static void benchInterpolation()
+{
+	const uint32_t subchunk = 4096;
+	const uint32_t bufLen = 262144;
+	const double tone = 1000.0;
+	auto input = makeTone(tone, AUDIO_RATE, AUDIO_RATE, 0.5f);
+	std::vector<float> output(bufLen);
+
+	if (enabled("_interpolation"))
+	{
+		LegacyInterpolator legacy;
+		size_t offset = 0;
+		double rate = measure([&]()
+		{
+			legacy.Run(&input[offset], subchunk, output.data(), bufLen);
+			offset = (offset + subchunk) % (input.size() - subchunk);
+		});
+		report("_interpolation legacy", rate * bufLen / 1e6, "Msamples/s");
+
+		HackRF_Resampler resampler;
+		resampler.SetRates(subchunk, bufLen);
+		offset = 0;
+		rate = measure([&]()
+		{
+			size_t produced = 0, written = 0;
+			while (produced < bufLen)
+			{
+				offset += resampler.Process(&input[offset], input.size() - offset, &output[produced], bufLen - produced, written);
+				produced += written;
+				if (offset >= input.size())
+					offset = 0;
+			}
+		});
+		report("HackRF_Resampler 4096->262144", rate * bufLen / 1e6, "Msamples/s", DEVICE_MAX_RATE);
+
+		resampler.SetRates(22050, DEVICE_RATE);
+		offset = 0;
+		rate = measure([&]()
+		{
+			size_t produced = 0, written = 0;
+			while (produced < bufLen)
+			{
+				offset += resampler.Process(&input[offset], input.size() - offset, &output[produced], bufLen - produced, written);
+				produced += written;
+				if (offset >= input.size())
+					offset = 0;
+			}
+		});
+		report("HackRF_Resampler 22050->2M", rate * bufLen / 1e6, "Msamples/s", DEVICE_MAX_RATE);
+	}
+
+	if (enabled("image rejection"))
+	{
+		//1 kHz tone at 48 kHz upsampled to 3.072 MHz. First image is at 47 kHz.
+		const uint32_t outRate = AUDIO_RATE * (bufLen / subchunk);
+		const double image = AUDIO_RATE - tone;
+		std::vector<float> legacyOut, polyOut;
+
+		LegacyInterpolator legacy;
+		for (size_t offset = 0; offset + subchunk <= input.size(); offset += subchunk)
+		{
+			legacy.Run(&input[offset], subchunk, output.data(), bufLen);
+			legacyOut.insert(legacyOut.end(), output.begin(), output.end());
+		}
+
+		HackRF_Resampler resampler;
+		resampler.SetRates(AUDIO_RATE, outRate);
+		polyOut.resize(size_t(input.size() * double(outRate) / AUDIO_RATE) + 64);
+		size_t produced = 0;
+		resampler.Process(input.data(), input.size(), polyOut.data(), polyOut.size(), produced);
+		polyOut.resize(produced);
+
+		//Skip the start, it has step from silence
+		size_t skip = outRate / 100;
+		double legacyDb = 10.0 * log10(power(legacyOut, skip, tone, outRate) / power(legacyOut, skip, image, outRate));
+		double polyDb = 10.0 * log10(power(polyOut, skip, tone, outRate) / power(polyOut, skip, image, outRate));
+		report("image rejection legacy", legacyDb, "dB");
+		report("image rejection HackRF_Resampler", polyDb, "dB", 60.0);
+	}
+}
+
+static void benchModulation()
+{
+	const size_t count = 131072;
+	auto audio = makeTone(1200.0, DEVICE_RATE, count, 0.8f);
+	std::vector<int8_t> iq(count * 2), reference(count * 2);
+	const float gain = 0.9f;
+	const double deviation = 4500.0;
+
+	if (!enabled("_modulation"))
+		return;
+
+	double refPhase = 0;
+	double rate = measure([&]() { referenceFM(audio.data(), count, gain, deviation, DEVICE_RATE, refPhase, reference.data()); });
+	report("_modulation reference sin/cos", rate * count / 1e6, "Msamples/s");
+
+	HackRF_Modulator::Phase_t phase = 0;
+	float scale = HackRF_Modulator::DeviationScale(deviation, DEVICE_RATE);
+	rate = measure([&]() { HackRF_Modulator::FM(audio.data(), count, gain, scale, phase, iq.data()); });
+	report("_modulation FM", rate * count / 1e6, "Msamples/s", DEVICE_MAX_RATE);
+
+	uint32_t dither = 1;
+	rate = measure([&]() { HackRF_Modulator::FM(audio.data(), count, gain, scale, phase, iq.data(), &dither); });
+	report("_modulation FM dithered", rate * count / 1e6, "Msamples/s", DEVICE_MAX_RATE);
+
+	//Same input from zero phase, table NCO must stay within quantization error of the reference
+	refPhase = 0;
+	phase = 0;
+	referenceFM(audio.data(), count, gain, deviation, DEVICE_RATE, refPhase, reference.data());
+	HackRF_Modulator::FM(audio.data(), count, gain, scale, phase, iq.data());
+	int maxError = 0;
+	for (size_t i = 0; i < iq.size(); i++)
+		maxError = std::max(maxError, abs(int(iq[i]) - int(reference[i])));
+	report("_modulation FM error", maxError, "LSB", 2.0, true);
+}
+
+static void benchRing()
+{
+	if (!enabled("HackRF_TxRing"))
+		return;
+
+	//Producer fills slots with running counter 1..255, consumer reads with random lengths across slot boundaries.
+	//Zero is never written, so zeroed tail after the published bytes is easy to tell.
+	const size_t slotSize = 4096;
+	const size_t total = 64ull * 1024 * 1024;
+	HackRF_TxRing ring(8, slotSize);
+	std::atomic<bool> done(false);
+
+	auto start = std::chrono::steady_clock::now();
+	std::thread producer([&]()
+	{
+		uint8_t counter = 1;
+		for (size_t written = 0; written < total; written += slotSize)
+		{
+			while (ring.FreeSlots() == 0)
+				std::this_thread::yield();
+
+			int8_t* slot = ring.WriteSlot(0);
+			for (size_t i = 0; i < slotSize; i++)
+			{
+				slot[i] = (int8_t)counter;
+				counter = counter == 255 ? 1 : counter + 1;
+			}
+			ring.Publish(1);
+		}
+		done = true;
+	});
+
+	uint8_t expected = 1;
+	size_t errors = 0, received = 0;
+	std::vector<int8_t> buf(slotSize * 3);
+	std::mt19937 rng(7);
+	while (received < total)
+	{
+		size_t length = 1 + rng() % buf.size();
+		if (!ring.Pop(buf.data(), length))
+		{
+			if (done && ring.Empty())
+				break;
+			std::this_thread::yield();
+			continue;
+		}
+
+		for (size_t i = 0; i < length && buf[i] != 0; i++, received++)
+		{
+			if ((uint8_t)buf[i] != expected)
+			{
+				errors++;
+				expected = (uint8_t)buf[i];
+			}
+			expected = expected == 255 ? 1 : expected + 1;
+		}
+	}
+	producer.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	report("HackRF_TxRing 2 threads", total / elapsed.count() / 1e6, "MB/s");
+	report("HackRF_TxRing errors", (double)errors + (received == total ? 0 : 1), "", 0.0, true);
+}
+
+static void benchQueue()
+{
+	if (!enabled("PushSamples") && !enabled("HackRF_ChunkPool"))
+		return;
+
+	//Queueing shares the source buffer, so cost must not depend on chunk length
+	HackRF_PCMSource source(makeTone(1200.0, AUDIO_RATE, AUDIO_RATE * 10, 0.8f), AUDIO_RATE);
+	HackRFTransmitter tx(std::make_unique<HackRF_NullDevice>(262144, 0.0));
+	size_t pushes = 0;
+	double rate = measure([&]()
+	{
+		tx.PushSamples(source);
+		if (++pushes % 4096 == 0)
+			tx.Clear();
+	});
+	tx.Clear();
+	report("PushSamples 10 s chunk", rate / 1e3, "k/s", 100.0);
+
+	//Released storage must come back on next Take() of the same size
+	const size_t count = AUDIO_RATE * 4;
+	auto buf = HackRF_ChunkPool::Take(count);
+	buf.resize(count);
+	const float* storage = buf.data();
+	HackRF_ChunkPool::Share(std::move(buf)).reset();
+	auto again = HackRF_ChunkPool::Take(count);
+	report("HackRF_ChunkPool reuse misses", again.data() == storage ? 0.0 : 1.0, "", 0.0, true);
+
+	rate = measure([&]()
+	{
+		auto samples = HackRF_ChunkPool::Take(count);
+		samples.resize(count);
+		sink = (uint32_t)HackRF_ChunkPool::Share(std::move(samples))->size();
+	});
+	report("HackRF_ChunkPool take/share", rate / 1e3, "k/s");
+}
+
+static void benchDecode()
+{
+	if (!enabled("Decode"))
+		return;
+
+	//Random input, result is compared with the plain formula in double precision
+	const size_t frames = 1 << 20;
+	std::mt19937 rng(11);
+	std::vector<uint8_t> input(frames * 4 * 2);
+	for (auto& b : input)
+		b = (uint8_t)rng();
+	std::vector<float> out(frames);
+
+	auto expected = [&](const uint8_t* p, uint16_t byterate) -> double
+	{
+		int64_t v = 0;
+		for (int b = byterate - 1; b >= 0; b--)
+			v = (v << 8) | p[b];
+		if (byterate == 1)
+			return (v - 128) * 256.0 / 65530;
+		if (v & (int64_t(1) << (byterate * 8 - 1)))
+			v -= int64_t(1) << (byterate * 8);
+		return v / 65530.0 / double(int64_t(1) << (8 * (byterate - 2)));
+	};
+
+	double maxError = 0;
+	for (uint16_t channels = 1; channels <= 2; channels++)
+	{
+		for (uint16_t byterate = 1; byterate <= 4; byterate++)
+		{
+			size_t frameBytes = size_t(byterate) * channels;
+			std::string name = std::to_string(byterate * 8) + " bit " + (channels == 1 ? "mono" : "stereo");
+
+			//Odd count runs through the scalar tail too
+			HackRF_PCMSource::Decode(input.data(), frames - 3, channels, byterate, out.data());
+			for (size_t i = 0; i < frames - 3; i++)
+			{
+				const uint8_t* p = &input[i * frameBytes];
+				double value = channels == 1 ? expected(p, byterate) : (expected(p, byterate) + expected(p + byterate, byterate)) / 2;
+				maxError = std::max(maxError, std::abs(value - out[i]));
+			}
+
+			double rate = measure([&]() { HackRF_PCMSource::Decode(input.data(), frames, channels, byterate, out.data()); });
+			report("Decode " + name, rate * frames * frameBytes / 1e6, "MB/s", 1000.0);
+			if (byterate == 2)
+			{
+				rate = measure([&]() { referenceDecode(input.data(), input.size(), channels, out.data(), frames * channels, byterate); });
+				report("Decode legacy " + name, rate * frames * frameBytes / 1e6, "MB/s");
+			}
+		}
+	}
+	report("Decode max error", maxError * 1e6, "ppm", 1.0, true);
+}
+
+static void benchWaveFile()
+{
+	if (!enabled("HackRF_PCMSource file") && !enabled("HackRF_WaveFile"))
+		return;
+
+	std::vector<uint8_t> wave = makeWave(60.0);
+	HackRF_PCMSource reference(wave);
+
+	//Odd sized LIST chunk between fmt and data, like many editors write. Samples must not move.
+	std::vector<uint8_t> list = { 'L', 'I', 'S', 'T', 101, 0, 0, 0 };
+	list.resize(list.size() + 101 + 1, 'x');
+	std::vector<uint8_t> tagged(wave.begin(), wave.begin() + 36);
+	tagged.insert(tagged.end(), list.begin(), list.end());
+	tagged.insert(tagged.end(), wave.begin() + 36, wave.end());
+	uint32_t riffSize = uint32_t(tagged.size() - 8);
+	memcpy(&tagged[4], &riffSize, sizeof(riffSize));
+
+	std::string fileName = writeTempFile("pocsag_benchmark_wave.wav", wave);
+	std::string taggedName = writeTempFile("pocsag_benchmark_tagged.wav", tagged);
+
+	size_t mismatches = 0;
+	auto compare = [&](const std::vector<float>& samples)
+	{
+		mismatches += samples == reference.GetRawBuf() ? 0 : 1;
+	};
+	compare(HackRF_PCMSource(taggedName).GetRawBuf());
+	compare(HackRF_PCMSource(tagged).GetRawBuf());
+	{
+		HackRF_FileStream stream(taggedName);
+		std::vector<float> samples(reference.GetRawBuf().size() + 1);
+		samples.resize(stream.Read(samples.data(), samples.size()));
+		compare(samples);
+	}
+	report("HackRF_WaveFile chunk mismatches", (double)mismatches, "", 0.0, true);
+
+	double rate = measure([&]() { sink = (uint32_t)HackRF_PCMSource(referenceReadFile(fileName)).GetRawBuf().size(); });
+	report("HackRF_PCMSource file legacy", 1000.0 / rate, "ms");
+	rate = measure([&]() { sink = (uint32_t)HackRF_PCMSource(fileName).GetRawBuf().size(); });
+	report("HackRF_PCMSource file mapped", 1000.0 / rate, "ms");
+
+	std::filesystem::remove(fileName);
+	std::filesystem::remove(taggedName);
+}
+
+static void benchStream()
+{
+	if (!enabled("Stream"))
+		return;
+
+	//60 s WAV file: stream must be ready at once and keep memory bounded
+	const double seconds = 60.0;
+	std::string fileName = writeTempFile("pocsag_benchmark_stream.wav", makeWave(seconds));
+
+	std::vector<float> first(4096);
+	double rate = measure([&]()
+	{
+		HackRF_FileStream stream(fileName);
+		sink = (uint32_t)stream.Read(first.data(), first.size());
+	});
+	report("HackRF_FileStream first samples", 1000.0 / rate, "ms", 5.0, true);
+
+	HackRFTransmitter tx(std::make_unique<HackRF_NullDevice>(262144, 0.0));
+	tx.SetFixedDeviceSampleRate(DEVICE_RATE);
+	tx.SetFMDeviationKHz(4.5);
+	tx.PushSamples(std::make_shared<HackRF_FileStream>(fileName));
+
+	size_t peak = 0;
+	auto start = std::chrono::steady_clock::now();
+	tx.StartTX();
+	while (!tx.WaitForIdle(std::chrono::milliseconds(5)))
+		peak = std::max(peak, tx.GetMemoryFootprint());
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	tx.StopTX();
+	std::filesystem::remove(fileName);
+
+	report("_work Stream real-time margin", seconds / elapsed.count(), "x", 1.5);
+	report("_work Stream peak memory", peak / 1048576.0, "MB", 8.0, true);
+
+	//Critical chunk in the middle of stream: stream must continue where it was, so both of them take as many samples
+	//as each one alone. Lost input of stream would be lost subchunk.
+	const std::string shortName = writeTempFile("pocsag_benchmark_preempt.wav", makeWave(5.0));
+	const std::vector<float> alert = makeTone(1000.0, AUDIO_RATE, AUDIO_RATE / 2, 0.8f);
+	auto transmitted = [&](bool withStream, bool withAlert)
+	{
+		auto device = std::make_unique<HackRF_CarrierCounter>(262144, 0.0);
+		HackRF_CarrierCounter* counter = device.get();
+		HackRFTransmitter tx(std::move(device));
+		tx.SetFixedDeviceSampleRate(DEVICE_RATE);
+		tx.SetFMDeviationKHz(4.5);
+		if (withStream)
+			tx.PushSamples(std::make_shared<HackRF_FileStream>(shortName));
+		else
+			tx.PushSamples(HackRF_PCMSource(std::vector<float>(alert), AUDIO_RATE), HackRFTransmitter::Priority::Critical);
+
+		tx.StartTX();
+		if (withStream && withAlert)
+		{
+			//About a second of stream
+			while (counter->GetCarrierSamples() < DEVICE_RATE && !tx.IsIdle())
+				std::this_thread::yield();
+			tx.PushSamples(HackRF_PCMSource(std::vector<float>(alert), AUDIO_RATE), HackRFTransmitter::Priority::Critical);
+		}
+		//Device counts tx buf after it has taken it from ring, stop joins its thread so the last one is counted
+		tx.WaitForIdle(std::chrono::milliseconds(600000));
+		tx.StopTX();
+		return counter->GetCarrierSamples();
+	};
+
+	uint64_t both = transmitted(true, true);
+	uint64_t separate = transmitted(true, false) + transmitted(false, true);
+	std::filesystem::remove(shortName);
+	report("_work Stream preemption lost samples", fabs(double(separate) - double(both)), "samples", 0.0, true);
+}
+
+static void benchPipeline()
+{
+	if (!enabled("_work"))
+		return;
+
+	//Whole worker: resampling, modulation and ring. Unpaced null device takes tx bufs as soon as worker publishes them,
+	//so time until idle is the time worker needs to produce the queue.
+	POCSAG::Encoder encoder(8, AUDIO_RATE);
+	std::vector<float> samples;
+	std::vector<POCSAG::Page> pages;
+	for (uint32_t i = 0; i < 16; i++)
+		pages.push_back({ 1000000 + i, POCSAG::Type::Alphanumeric, "Benchmark page number " + std::to_string(i) });
+	encoder.encodeSamples(samples, pages, POCSAG::BPS::BPS_1200);
+	double seconds = double(samples.size()) / AUDIO_RATE;
+
+	const uint32_t deviceRates[] = { DEVICE_RATE, 20000000 };
+	for (uint32_t deviceRate : deviceRates)
+	{
+		HackRFTransmitter tx(std::make_unique<HackRF_NullDevice>(262144, 0.0));
+		tx.SetFixedDeviceSampleRate(deviceRate);
+		tx.SetFMDeviationKHz(4.5);
+		tx.PushSamples(HackRF_PCMSource(std::vector<float>(samples), AUDIO_RATE));
+
+		auto start = std::chrono::steady_clock::now();
+		tx.StartTX();
+		tx.WaitForIdle(std::chrono::milliseconds(600000));
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		tx.StopTX();
+
+		double margin = seconds / elapsed.count();
+		std::string name = "_work at " + std::to_string(deviceRate / 1000000) + " MHz";
+		report(name, seconds * deviceRate / elapsed.count() / 1e6, "Msamples/s");
+		report(name + " real-time margin", margin, "x", 1.5);
+	}
+
+	//Minimum sample rate encoding, 4800 Hz at 1200 bps. Legacy mode would put device to 614 kHz, it must stay at 2 MHz.
+	POCSAG::Encoder minimal(8, AUDIO_RATE, 4);
+	minimal.encodeSamples(samples, pages, POCSAG::BPS::BPS_1200);
+	const uint32_t minimalRate = minimal.GetSampleRate(POCSAG::BPS::BPS_1200);
+	const uint32_t fixedRates[] = { DEVICE_RATE, 0 };
+	for (uint32_t fixedRate : fixedRates)
+	{
+		auto device = std::make_unique<HackRF_NullDevice>(262144, 0.0);
+		HackRF_NullDevice* null = device.get();
+		HackRFTransmitter tx(std::move(device));
+		tx.SetFixedDeviceSampleRate(fixedRate);
+		tx.SetFMDeviationKHz(4.5);
+		tx.PushSamples(HackRF_PCMSource(std::vector<float>(samples), minimalRate));
+
+		auto start = std::chrono::steady_clock::now();
+		tx.StartTX();
+		tx.WaitForIdle(std::chrono::milliseconds(600000));
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		uint32_t deviceRate = null->GetSampleRate();
+		tx.StopTX();
+
+		std::string name = std::string("_work minimum rate ") + (fixedRate != 0 ? "fixed" : "legacy");
+		report(name + " real-time margin", seconds / elapsed.count(), "x", 1.5);
+		if (fixedRate == 0)
+			report(name + " device rate", deviceRate / 1e6, "MHz", MIN_DEVICE_RATE);
+	}
+
+	//Every bitrate has it's own rate in minimum sample rate encoding, 44100 and 22050 Hz chunks put device to other rates.
+	//Chunks are queued back to back, so tx bufs of the previous rate are still in ring when device rate has to change.
+	//Paced device keeps ring full like real one does. Every chunk can be longer by its padded last subchunk.
+	//Bufs clocked at wrong rate make error of N / new rate - N / old rate at each change, it sums up to N / last rate -
+	//N / first rate, so the last rate must differ from the first one.
+	std::vector<std::pair<std::vector<float>, uint32_t>> chunks;
+	chunks.push_back({ makeTone(1200.0, 44100, 44100, 0.8f), 44100 });
+	chunks.push_back({ makeTone(1200.0, 22050, 22050, 0.8f), 22050 });
+	std::vector<POCSAG::Page> twoPages(pages.begin(), pages.begin() + 2);
+	for (POCSAG::BPS bps : { POCSAG::BPS::BPS_1200, POCSAG::BPS::BPS_2400, POCSAG::BPS::BPS_512 })
+	{
+		minimal.encodeSamples(samples, twoPages, bps);
+		chunks.push_back({ samples, minimal.GetSampleRate(bps) });
+	}
+
+	auto device = std::make_unique<HackRF_CarrierCounter>(262144, 4.0);
+	HackRF_CarrierCounter* counter = device.get();
+	HackRFTransmitter tx(std::move(device));
+	tx.SetFixedDeviceSampleRate(0);
+	tx.SetFMDeviationKHz(4.5);
+	double expected = 0, padding = 0;
+	for (auto& [pcm, rate] : chunks)
+	{
+		//Legacy device rate: subchunk of 2048 PCM samples is one transfer, but not lower than 2 MHz
+		expected += double(pcm.size()) / rate;
+		padding += 262144.0 / std::max<double>(DEVICE_RATE, rate / 2048.0 * 262144);
+		tx.PushSamples(HackRF_PCMSource(std::move(pcm), rate));
+	}
+	tx.StartTX();
+	tx.WaitForIdle(std::chrono::milliseconds(600000));
+	tx.StopTX();
+	report("_work legacy mixed rates airtime error", fabs(counter->GetCarrierSeconds() - expected) * 1000.0, "ms", padding * 1000.0, true);
+
+	//FSK chunk puts device to 2 MHz in legacy mode, PCM chunk queued behind it changes the rate. The tail of the page
+	//synthesized at 2 MHz must not be clocked out at PCM rate.
+	std::vector<uint8_t> raw;
+	minimal.encode(raw, twoPages, POCSAG::BPS::BPS_1200, true);
+	HackRF_FSKSource fsk(raw, 1200);
+	const std::vector<float> tone = makeTone(1200.0, 44100, 44100, 0.8f);
+
+	auto fskDevice = std::make_unique<HackRF_CarrierCounter>(262144, 4.0);
+	HackRF_CarrierCounter* fskCounter = fskDevice.get();
+	HackRFTransmitter fskTx(std::move(fskDevice));
+	fskTx.SetFixedDeviceSampleRate(0);
+	fskTx.SetFMDeviationKHz(4.5);
+	fskTx.PushSamples(fsk);
+	fskTx.StartTX();
+	fskTx.PushSamples(HackRF_PCMSource(std::vector<float>(tone), 44100)); //Pushed before start it would set device rate
+	fskTx.WaitForIdle(std::chrono::milliseconds(600000));
+	fskTx.StopTX();
+	expected = double(fsk.GetBitCount()) / 1200 + double(tone.size()) / 44100;
+	padding = 262144.0 / DEVICE_RATE + 262144.0 / (44100 / 2048.0 * 262144);
+	report("_work legacy FSK then PCM airtime error", fabs(fskCounter->GetCarrierSeconds() - expected) * 1000.0, "ms", padding * 1000.0, true);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1)
+		filter = argv[1];
+
+	std::cout << std::left << std::setw(34) << "Stage" << std::right << std::setw(14) << "Result" << " " << std::left << std::setw(12) << "Unit" << "Threshold" << std::endl;
+
+	try
+	{
+		benchEncoder();
+		benchBatch();
+		benchInterpolation();
+		benchModulation();
+		benchRing();
+		benchQueue();
+		benchDecode();
+		benchWaveFile();
+		benchStream();
+		benchPipeline();
+	}
+	catch (const std::exception& ex)
+	{
+		std::cout << "Error: " << ex.what() << std::endl;
+		return 1;
+	}
+
+	size_t failed = 0;
+	for (const auto& r : results)
+		failed += r.Passed() ? 0 : 1;
+
+	std::cout << std::endl << results.size() << " results, " << failed << " failed" << std::endl;
+	return failed == 0 ? 0 : 1;
+}
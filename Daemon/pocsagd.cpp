@@ -0,0 +1,571 @@
+/*
+*  Subject: pocsagd
+*  Purpose: Headless paging daemon. Reads page requests from stdin or spool directory, encodes and transmits them continuously.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "POCSAG.h"
+#include "HackRF_PCMSource.h"
+#include "HackRF_VirtualDevice.h"
+#include "HackRFTransmitter.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cctype>
+#include <ctime>
+
+//Request is one line: RIC type[:FUNC] message
+//Type is a|alpha, n|numeric or t|tone, FUNC is A-D (A by default). Empty lines and lines starting with # are skipped.
+//Example: 1234567 alpha:C Server room temperature is too high
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+	uint64_t frequency = 0;
+	float gainRF = 0;
+	bool amp = false;
+	double deviationKHz = 4.5;
+	POCSAG::BPS bps = POCSAG::BPS::BPS_1200;
+	POCSAG::Charset charset = POCSAG::Charset::Latin;
+	uint32_t pcmSampleRate = 48000;
+	uint32_t samplesPerBit = 0;				//Minimum sample rate encoding at bps * samplesPerBit if not 0
+	uint32_t deviceSampleRate = 2000000;	//0 to follow PCM sample rate
+	std::string device = "hackrf";			//hackrf, null or file:PATH
+	std::string spool;						//Read requests from stdin if empty
+	uint32_t batchWindowMs = 200;			//How long to collect requests after the first one before encoding
+	size_t maxBatch = 64;					//Max pages in one transmission
+	uint32_t statsSeconds = 60;				//0 to disable periodic stats
+};
+
+struct Request
+{
+	POCSAG::Page page;
+	Clock::time_point receivedAt;
+};
+
+//Shared with reader threads, so stdin reader blocked in getline may outlive main()
+class RequestQueue
+{
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<Request> m_requests;
+	bool m_closed = false;
+
+public:
+	void Push(Request&& request)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_requests.push_back(std::move(request));
+		}
+		m_cv.notify_all();
+	}
+
+	//No more requests will be pushed
+	void Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_closed = true;
+		}
+		m_cv.notify_all();
+	}
+
+	void Wake()
+	{
+		m_cv.notify_all();
+	}
+
+	//Waits for the first request, then collects more until window passed or maxCount reached.
+	//Returns empty batch on timeout or if queue is closed and empty.
+	std::vector<Request> PopBatch(size_t maxCount, std::chrono::milliseconds window, std::chrono::milliseconds timeout, const std::atomic<bool>& stop)
+	{
+		std::vector<Request> batch;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (!m_cv.wait_for(lock, timeout, [&]() { return !m_requests.empty() || m_closed || stop; }) || m_requests.empty())
+			return batch;
+
+		auto deadline = m_requests.front().receivedAt + window;
+		m_cv.wait_until(lock, deadline, [&]() { return m_requests.size() >= maxCount || m_closed || stop; });
+
+		size_t count = std::min(maxCount, m_requests.size());
+		for (size_t i = 0; i < count; i++)
+		{
+			batch.push_back(std::move(m_requests.front()));
+			m_requests.pop_front();
+		}
+		return batch;
+	}
+
+	size_t Size()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_requests.size();
+	}
+
+	bool Drained()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_closed && m_requests.empty();
+	}
+};
+
+struct Stats
+{
+	size_t pages = 0;
+	size_t rejected = 0;
+	size_t transmissions = 0;
+	double airSeconds = 0;
+	double encodeSeconds = 0;
+	double latencySum = 0;
+	double latencyMax = 0;
+	Clock::time_point since = Clock::now();
+};
+
+static std::atomic<bool> stopRequested(false);
+
+static void onSignal(int)
+{
+	stopRequested = true;
+}
+
+static void log(const std::string& line)
+{
+	auto now = std::chrono::system_clock::now();
+	auto time_t_now = std::chrono::system_clock::to_time_t(now);
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+	std::tm tm_now;
+#ifdef _WIN32
+	localtime_s(&tm_now, &time_t_now);
+#else
+	localtime_r(&time_t_now, &tm_now);
+#endif
+
+	std::ostringstream oss;
+	oss << std::put_time(&tm_now, "%Y-%m-%d %H:%M:%S") << "." << std::setw(3) << std::setfill('0') << ms << " " << line << "\n";
+	std::cerr << oss.str() << std::flush;
+}
+
+static std::string trim(const std::string& str)
+{
+	size_t first = str.find_first_not_of(" \t\r\n");
+	if (first == std::string::npos)
+		return "";
+	size_t last = str.find_last_not_of(" \t\r\n");
+	return str.substr(first, last - first + 1);
+}
+
+static std::string lower(std::string str)
+{
+	std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	return str;
+}
+
+//False if line is not a request. Throws on malformed request.
+static bool parseRequest(const std::string& rawLine, POCSAG::Charset charset, POCSAG::Page& page)
+{
+	std::string line = trim(rawLine);
+	if (line.empty() || line[0] == '#')
+		return false;
+
+	std::istringstream iss(line);
+	std::string ric, type;
+	if (!(iss >> ric >> type))
+		throw std::runtime_error("Expected: RIC type[:FUNC] message");
+
+	if (ric.size() > 7 || ric.find_first_not_of("0123456789") != std::string::npos)
+		throw std::runtime_error("Invalid RIC '" + ric + "'");
+
+	page.address = std::stoul(ric);
+	page.charset = charset;
+	page.func = POCSAG::Function::A;
+
+	size_t colon = type.find(':');
+	if (colon != std::string::npos)
+	{
+		std::string func = lower(type.substr(colon + 1));
+		type = type.substr(0, colon);
+		if (func.size() != 1 || func[0] < 'a' || func[0] > 'd')
+			throw std::runtime_error("Invalid function '" + func + "', expected A-D");
+		page.func = POCSAG::Function(func[0] - 'a');
+	}
+
+	type = lower(type);
+	if (type == "a" || type == "alpha")
+		page.type = POCSAG::Type::Alphanumeric;
+	else if (type == "n" || type == "numeric")
+		page.type = POCSAG::Type::Numeric;
+	else if (type == "t" || type == "tone")
+		page.type = POCSAG::Type::Tone;
+	else
+		throw std::runtime_error("Invalid type '" + type + "'");
+
+	std::getline(iss >> std::ws, page.message);
+	if (page.type == POCSAG::Type::Tone)
+		page.message.clear();
+
+	return true;
+}
+
+static void readLine(const std::string& line, const std::string& origin, const Options& opts, RequestQueue& queue)
+{
+	try
+	{
+		Request request;
+		if (parseRequest(line, opts.charset, request.page))
+		{
+			request.receivedAt = Clock::now();
+			queue.Push(std::move(request));
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		log("Rejected request from " + origin + ": " + ex.what());
+	}
+}
+
+static void stdinReader(std::shared_ptr<RequestQueue> queue, Options opts)
+{
+	std::string line;
+	while (!stopRequested && std::getline(std::cin, line))
+		readLine(line, "stdin", opts, *queue);
+
+	if (!stopRequested)
+		log("End of input, draining queue");
+	queue->Close();
+}
+
+//Spool writers must create file under dot name and rename it when it's complete. Every file is deleted after reading.
+static void spoolReader(std::shared_ptr<RequestQueue> queue, Options opts)
+{
+	namespace fs = std::filesystem;
+	while (!stopRequested)
+	{
+		std::vector<fs::path> files;
+		std::error_code ec;
+		for (fs::directory_iterator it(opts.spool, ec), end; !ec && it != end; it.increment(ec))
+		{
+			if (it->is_regular_file(ec) && it->path().filename().string()[0] != '.')
+				files.push_back(it->path());
+		}
+		if (ec)
+			log("Failed to read spool directory: " + ec.message());
+
+		std::sort(files.begin(), files.end());
+		for (const auto& file : files)
+		{
+			std::ifstream in(file);
+			std::string line;
+			while (std::getline(in, line))
+				readLine(line, file.filename().string(), opts, *queue);
+			in.close();
+
+			if (!fs::remove(file, ec))
+				log("Failed to remove " + file.string() + ": " + ec.message());
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	queue->Close();
+}
+
+static std::unique_ptr<IHackRFDevice> makeDevice(const std::string& device)
+{
+	if (device == "null")
+		return std::make_unique<HackRF_NullDevice>();
+	if (device.rfind("file:", 0) == 0)
+		return std::make_unique<HackRF_FileDevice>(device.substr(5));
+	if (device == "hackrf")
+		return nullptr; //Default backend of transmitter
+	throw std::runtime_error("Unknown device '" + device + "', expected hackrf, null or file:PATH");
+}
+
+//Encodes batch into one transmission. Pages which can't be encoded are logged and dropped.
+static double encodeBatch(POCSAG::Encoder& encoder, const Options& opts, std::vector<Request>& batch, std::vector<float>& samples, Stats& stats)
+{
+	std::vector<POCSAG::Page> pages;
+	for (const auto& r : batch)
+		pages.push_back(r.page);
+
+	POCSAG::TransmissionStats txStats;
+	try
+	{
+		encoder.encodeSamples(samples, pages, opts.bps, &txStats);
+		return txStats.airtimeSec;
+	}
+	catch (const std::exception&)
+	{
+		//Find bad pages one by one, then encode the rest again
+	}
+
+	std::vector<Request> valid;
+	std::vector<float> probe;
+	for (auto& r : batch)
+	{
+		try
+		{
+			encoder.encodeSamples(probe, r.page.address, r.page.type, r.page.message, opts.bps, r.page.charset, r.page.func);
+			valid.push_back(std::move(r));
+		}
+		catch (const std::exception& ex)
+		{
+			stats.rejected++;
+			log("Dropped page for RIC " + std::to_string(r.page.address) + ": " + ex.what());
+		}
+	}
+
+	batch = std::move(valid);
+	if (batch.empty())
+		return 0;
+
+	pages.clear();
+	for (const auto& r : batch)
+		pages.push_back(r.page);
+	encoder.encodeSamples(samples, pages, opts.bps, &txStats);
+	return txStats.airtimeSec;
+}
+
+static void printStats(Stats& stats, size_t queued, const HackRFTransmitter& tx)
+{
+	double elapsed = std::chrono::duration<double>(Clock::now() - stats.since).count();
+	std::ostringstream oss;
+	oss << std::fixed << std::setprecision(2)
+		<< "Stats: " << stats.pages << " pages in " << stats.transmissions << " transmissions, "
+		<< stats.rejected << " rejected, "
+		<< stats.pages / elapsed << " pages/s, "
+		<< "air " << stats.airSeconds << " s (" << 100.0 * stats.airSeconds / elapsed << "% duty), "
+		<< "encode " << (stats.transmissions ? 1000.0 * stats.encodeSeconds / stats.transmissions : 0.0) << " ms/tx, "
+		<< "latency avg " << (stats.pages ? stats.latencySum / stats.pages : 0.0) << " s max " << stats.latencyMax << " s, "
+		<< "queued " << queued << ", "
+		<< "memory " << tx.GetMemoryFootprint() / 1024 << " KB";
+	log(oss.str());
+
+	stats = Stats();
+}
+
+static void usage()
+{
+	std::cerr <<
+		"Usage: pocsagd --frequency HZ [options]\n"
+		"  --frequency HZ        Carrier frequency in Hz\n"
+		"  --gain DB             RF gain, 0-47 (default 0)\n"
+		"  --amp                 Enable amplifier\n"
+		"  --deviation KHZ       FM deviation (default 4.5)\n"
+		"  --bps 512|1200|2400   POCSAG bitrate (default 1200)\n"
+		"  --charset latin|cyrillic|raw\n"
+		"  --pcm-rate HZ         Encoder sample rate (default 48000)\n"
+		"  --samples-per-bit N   Encode at bps * N Hz instead of PCM rate, 0 to disable (default 0)\n"
+		"  --sample-rate HZ      Fixed device sample rate, 2-20 MHz or 0 to follow PCM (default 2000000)\n"
+		"  --device DEV          hackrf, null or file:PATH.cs8 (default hackrf)\n"
+		"  --spool DIR           Read request files from directory instead of stdin\n"
+		"  --batch-window MS     Collect requests for this long before transmission (default 200)\n"
+		"  --max-batch N         Max pages in one transmission (default 64)\n"
+		"  --stats SECONDS       Stats interval, 0 to disable (default 60)\n"
+		"Request line: RIC a|alpha|n|numeric|t|tone[:A-D] message\n";
+}
+
+static Options parseArgs(int argc, char* argv[])
+{
+	Options opts;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		auto value = [&]() -> std::string
+		{
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value of " + arg);
+			return argv[++i];
+		};
+
+		if (arg == "--frequency")
+			opts.frequency = std::stoull(value());
+		else if (arg == "--gain")
+			opts.gainRF = std::stof(value());
+		else if (arg == "--amp")
+			opts.amp = true;
+		else if (arg == "--deviation")
+			opts.deviationKHz = std::stod(value());
+		else if (arg == "--bps")
+		{
+			unsigned long bps = std::stoul(value());
+			if (bps != 512 && bps != 1200 && bps != 2400)
+				throw std::runtime_error("Bitrate must be 512, 1200 or 2400");
+			opts.bps = POCSAG::BPS(bps);
+		}
+		else if (arg == "--charset")
+		{
+			std::string charset = lower(value());
+			if (charset == "latin")
+				opts.charset = POCSAG::Charset::Latin;
+			else if (charset == "cyrillic")
+				opts.charset = POCSAG::Charset::Cyrilic;
+			else if (charset == "raw")
+				opts.charset = POCSAG::Charset::Raw;
+			else
+				throw std::runtime_error("Unknown charset '" + charset + "'");
+		}
+		else if (arg == "--pcm-rate")
+			opts.pcmSampleRate = (uint32_t)std::stoul(value());
+		else if (arg == "--samples-per-bit")
+			opts.samplesPerBit = (uint32_t)std::stoul(value());
+		else if (arg == "--sample-rate")
+			opts.deviceSampleRate = (uint32_t)std::stoul(value());
+		else if (arg == "--device")
+			opts.device = value();
+		else if (arg == "--spool")
+			opts.spool = value();
+		else if (arg == "--batch-window")
+			opts.batchWindowMs = (uint32_t)std::stoul(value());
+		else if (arg == "--max-batch")
+			opts.maxBatch = std::max<size_t>(1, std::stoul(value()));
+		else if (arg == "--stats")
+			opts.statsSeconds = (uint32_t)std::stoul(value());
+		else if (arg == "--help" || arg == "-h")
+		{
+			usage();
+			exit(0);
+		}
+		else
+			throw std::runtime_error("Unknown option " + arg);
+	}
+
+	if (opts.frequency == 0)
+		throw std::runtime_error("Frequency is not set");
+	return opts;
+}
+
+int main(int argc, char* argv[])
+{
+	Options opts;
+	try
+	{
+		opts = parseArgs(argc, argv);
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << "\n";
+		usage();
+		return 2;
+	}
+
+	std::signal(SIGINT, onSignal);
+	std::signal(SIGTERM, onSignal);
+
+	try
+	{
+		POCSAG::Encoder encoder(8, opts.pcmSampleRate, opts.samplesPerBit);
+		auto device = makeDevice(opts.device);
+		HackRFTransmitter tx = device ? HackRFTransmitter(std::move(device)) : HackRFTransmitter();
+		tx.SetFrequency(opts.frequency);
+		tx.SetGainRF(opts.gainRF);
+		tx.SetAMP(opts.amp);
+		tx.SetFMDeviationKHz(opts.deviationKHz);
+		tx.SetFixedDeviceSampleRate(opts.deviceSampleRate);
+		tx.SetTurnOffTXWhenIdle(true); //Radio is on air only while there is something to send
+		if (!tx.StartTX())
+			throw std::runtime_error("Failed to start TX");
+
+		auto queue = std::make_shared<RequestQueue>();
+		std::thread reader;
+		if (opts.spool.empty())
+			std::thread(stdinReader, queue, opts).detach(); //Can't interrupt getline, so it is never joined
+		else
+			reader = std::thread(spoolReader, queue, opts);
+
+		log("Started on " + std::to_string(opts.frequency) + " Hz, device " + opts.device + ", reading " + (opts.spool.empty() ? "stdin" : opts.spool));
+
+		Stats stats;
+		Clock::time_point txEnd = Clock::now();	//Projected end of everything pushed to transmitter
+		Clock::time_point nextStats = Clock::now() + std::chrono::seconds(opts.statsSeconds);
+		std::vector<float> samples;
+
+		while (!stopRequested && !queue->Drained())
+		{
+			auto batch = queue->PopBatch(opts.maxBatch, std::chrono::milliseconds(opts.batchWindowMs), std::chrono::milliseconds(500), stopRequested);
+			if (!batch.empty())
+			{
+				auto encodeStart = Clock::now();
+				double airtime = encodeBatch(encoder, opts, batch, samples, stats);
+				auto encodeEnd = Clock::now();
+
+				if (!batch.empty())
+				{
+					//Storage of transmitted batch comes back through pool
+					size_t sampleCount = samples.size();
+					tx.PushSamples(HackRF_PCMSource(std::move(samples), encoder.GetSampleRate(opts.bps)));
+					samples = HackRF_ChunkPool::Take(sampleCount);
+
+					txEnd = std::max(txEnd, encodeEnd) + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(airtime));
+					double maxLatency = 0;
+					for (const auto& r : batch)
+					{
+						double latency = std::chrono::duration<double>(txEnd - r.receivedAt).count();
+						maxLatency = std::max(maxLatency, latency);
+						stats.latencySum += latency;
+					}
+
+					double encodeSeconds = std::chrono::duration<double>(encodeEnd - encodeStart).count();
+					stats.pages += batch.size();
+					stats.transmissions++;
+					stats.airSeconds += airtime;
+					stats.encodeSeconds += encodeSeconds;
+					stats.latencyMax = std::max(stats.latencyMax, maxLatency);
+
+					std::ostringstream oss;
+					oss << std::fixed << std::setprecision(3) << "Transmission of " << batch.size() << " pages, air " << airtime << " s, encode "
+						<< encodeSeconds * 1000.0 << " ms, latency up to " << maxLatency << " s";
+					log(oss.str());
+				}
+			}
+
+			if (opts.statsSeconds && Clock::now() >= nextStats)
+			{
+				printStats(stats, queue->Size(), tx);
+				nextStats = Clock::now() + std::chrono::seconds(opts.statsSeconds);
+			}
+		}
+
+		queue->Wake();
+		if (reader.joinable())
+			reader.join();
+
+		//Let the pushed transmissions finish. Second signal isn't handled, so it kills the process.
+		if (stopRequested)
+			log("Stop requested, finishing transmissions in progress, " + std::to_string(queue->Size()) + " queued pages are dropped");
+		std::signal(SIGINT, SIG_DFL);
+		std::signal(SIGTERM, SIG_DFL);
+
+		auto left = txEnd - Clock::now();
+		tx.WaitForIdle(std::chrono::duration_cast<std::chrono::milliseconds>(left) + std::chrono::seconds(5));
+		tx.StopTX();
+
+		if (opts.statsSeconds)
+			printStats(stats, queue->Size(), tx);
+		log("Stopped");
+	}
+	catch (const std::exception& ex)
+	{
+		log(std::string("Error: ") + ex.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+/*
+*  Subject: GatewayProtocol
+*  Purpose: Framed binary protocol of POCSAG paging gateway. Shared by gateway and its clients.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//All integers are little endian. Every frame starts with u32 size of the rest of frame.
+//Request: size | u32 id | u32 ric | u8 type | u16 bps | u8 charset | u8 function | text
+//Ack:     size | u32 id | u8 status | u32 queuePosition | u32 airtimeMs | u32 etaMs | error text
+//Type, charset and function have values of POCSAG::Type, POCSAG::Charset and POCSAG::Function.
+//Id is chosen by client and returned in ack. Acks of one connection may come in different order than requests.
+namespace GatewayProtocol
+{
+	constexpr uint32_t REQUEST_HEADER_SIZE	= 13;
+	constexpr uint32_t ACK_HEADER_SIZE		= 17;
+	constexpr uint32_t MAX_FRAME_SIZE		= 4096;
+
+	enum class Status : uint8_t
+	{
+		Queued,			//Page is encoded and queued for TX
+		BadRequest,		//Malformed frame or unknown type, bps, charset or function
+		EncodeFailed,	//Encoder rejected the page, e.g. RIC or text is too long
+		Overloaded,		//Transmitter backlog is longer than gateway allows
+		ShuttingDown
+	};
+
+	struct Request
+	{
+		uint32_t id = 0;
+		uint32_t ric = 0;
+		uint8_t type = 0;
+		uint16_t bps = 1200;
+		uint8_t charset = 1;
+		uint8_t function = 0;
+		std::string text;
+	};
+
+	struct Ack
+	{
+		uint32_t id = 0;
+		Status status = Status::Queued;
+		uint32_t queuePosition = 0;	//Pages queued for TX ahead of this one
+		uint32_t airtimeMs = 0;		//Air time of transmission which carries the page
+		uint32_t etaMs = 0;			//Estimated time until that transmission ends
+		std::string error;
+	};
+
+	inline void put(std::vector<uint8_t>& out, uint32_t value, size_t bytes)
+	{
+		for (size_t i = 0; i < bytes; i++)
+			out.push_back(uint8_t(value >> (i * 8)));
+	}
+
+	inline uint32_t get(const uint8_t* in, size_t bytes)
+	{
+		uint32_t value = 0;
+		for (size_t i = 0; i < bytes; i++)
+			value |= uint32_t(in[i]) << (i * 8);
+		return value;
+	}
+
+	//Appends whole frame including size
+	inline void Write(std::vector<uint8_t>& out, const Request& r)
+	{
+		put(out, REQUEST_HEADER_SIZE + (uint32_t)r.text.size(), 4);
+		put(out, r.id, 4);
+		put(out, r.ric, 4);
+		put(out, r.type, 1);
+		put(out, r.bps, 2);
+		put(out, r.charset, 1);
+		put(out, r.function, 1);
+		out.insert(out.end(), r.text.begin(), r.text.end());
+	}
+
+	inline void Write(std::vector<uint8_t>& out, const Ack& a)
+	{
+		put(out, ACK_HEADER_SIZE + (uint32_t)a.error.size(), 4);
+		put(out, a.id, 4);
+		put(out, (uint32_t)a.status, 1);
+		put(out, a.queuePosition, 4);
+		put(out, a.airtimeMs, 4);
+		put(out, a.etaMs, 4);
+		out.insert(out.end(), a.error.begin(), a.error.end());
+	}
+
+	//Frame is everything after size. False if frame is too short.
+	inline bool Read(const uint8_t* frame, size_t size, Request& r)
+	{
+		if (size < REQUEST_HEADER_SIZE)
+			return false;
+
+		r.id = get(frame, 4);
+		r.ric = get(frame + 4, 4);
+		r.type = (uint8_t)get(frame + 8, 1);
+		r.bps = (uint16_t)get(frame + 9, 2);
+		r.charset = (uint8_t)get(frame + 11, 1);
+		r.function = (uint8_t)get(frame + 12, 1);
+		r.text.assign((const char*)frame + REQUEST_HEADER_SIZE, size - REQUEST_HEADER_SIZE);
+		return true;
+	}
+
+	inline bool Read(const uint8_t* frame, size_t size, Ack& a)
+	{
+		if (size < ACK_HEADER_SIZE)
+			return false;
+
+		a.id = get(frame, 4);
+		a.status = (Status)get(frame + 4, 1);
+		a.queuePosition = get(frame + 5, 4);
+		a.airtimeMs = get(frame + 9, 4);
+		a.etaMs = get(frame + 13, 4);
+		a.error.assign((const char*)frame + ACK_HEADER_SIZE, size - ACK_HEADER_SIZE);
+		return true;
+	}
+}
@@ -0,0 +1,241 @@
+/*
+*  Subject: GatewaySocket
+*  Purpose: Blocking Unix and TCP socket helpers for paging gateway and its clients. POSIX only.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "GatewaySocket.h"
+#include "GatewayProtocol.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+struct Address
+{
+	bool isUnix = false;
+	std::string path;	//Unix socket
+	std::string host;	//TCP, empty for all interfaces
+	std::string port;
+};
+
+static Address parseAddress(const std::string& address)
+{
+	Address result;
+	if (address.rfind("unix:", 0) == 0)
+	{
+		result.isUnix = true;
+		result.path = address.substr(5);
+		if (result.path.empty() || result.path.size() >= sizeof(sockaddr_un::sun_path))
+			throw std::runtime_error("Invalid unix socket path '" + result.path + "'");
+		return result;
+	}
+
+	if (address.rfind("tcp:", 0) == 0)
+	{
+		std::string rest = address.substr(4);
+		size_t colon = rest.rfind(':');
+		if (colon != std::string::npos)
+		{
+			result.host = rest.substr(0, colon);
+			result.port = rest.substr(colon + 1);
+		}
+		else
+			result.port = rest;
+
+		if (result.port.empty())
+			throw std::runtime_error("Port is missing in '" + address + "'");
+		return result;
+	}
+
+	throw std::runtime_error("Invalid address '" + address + "', expected unix:PATH or tcp:[HOST:]PORT");
+}
+
+static int unixSocket(const Address& addr, sockaddr_un& sa)
+{
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strncpy(sa.sun_path, addr.path.c_str(), sizeof(sa.sun_path) - 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		throw std::runtime_error(std::string("Failed to create socket: ") + strerror(errno));
+	return fd;
+}
+
+//Calls func for every resolved address until it returns valid socket
+template<typename Func>
+static int tcpSocket(const Address& addr, bool passive, Func func)
+{
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+	addrinfo* list = nullptr;
+	int err = getaddrinfo(addr.host.empty() ? nullptr : addr.host.c_str(), addr.port.c_str(), &hints, &list);
+	if (err != 0)
+		throw std::runtime_error(std::string("Failed to resolve address: ") + gai_strerror(err));
+
+	int fd = -1;
+	int lastErrno = 0;
+	for (addrinfo* ai = list; ai && fd < 0; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		//Acks are small and latency matters
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (!func(fd, ai))
+		{
+			lastErrno = errno;
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(list);
+
+	if (fd < 0)
+		throw std::runtime_error(std::string("Failed to open socket: ") + strerror(lastErrno));
+	return fd;
+}
+
+int GatewayListen(const std::string& address)
+{
+	Address addr = parseAddress(address);
+	if (addr.isUnix)
+	{
+		sockaddr_un sa;
+		int fd = unixSocket(addr, sa);
+		unlink(addr.path.c_str()); //Left by previous run
+		if (bind(fd, (sockaddr*)&sa, sizeof(sa)) != 0 || listen(fd, SOMAXCONN) != 0)
+		{
+			int err = errno;
+			close(fd);
+			throw std::runtime_error("Failed to listen on " + address + ": " + strerror(err));
+		}
+		return fd;
+	}
+
+	return tcpSocket(addr, true, [](int fd, addrinfo* ai)
+	{
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		return bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+	});
+}
+
+int GatewayConnect(const std::string& address)
+{
+	Address addr = parseAddress(address);
+	if (addr.isUnix)
+	{
+		sockaddr_un sa;
+		int fd = unixSocket(addr, sa);
+		if (connect(fd, (sockaddr*)&sa, sizeof(sa)) != 0)
+		{
+			int err = errno;
+			close(fd);
+			throw std::runtime_error("Failed to connect to " + address + ": " + strerror(err));
+		}
+		return fd;
+	}
+
+	return tcpSocket(addr, false, [](int fd, addrinfo* ai)
+	{
+		return connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+	});
+}
+
+int GatewayAccept(int listenFd)
+{
+	int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+	if (fd >= 0)
+	{
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); //Fails harmlessly on unix socket
+	}
+	return fd;
+}
+
+bool GatewayWaitReadable(int fd, int timeoutMs)
+{
+	pollfd pfd = { fd, POLLIN, 0 };
+	return poll(&pfd, 1, timeoutMs) > 0;
+}
+
+bool GatewayReadExact(int fd, void* buffer, size_t size)
+{
+	uint8_t* p = (uint8_t*)buffer;
+	while (size > 0)
+	{
+		ssize_t n = recv(fd, p, size, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+bool GatewayWriteAll(int fd, const void* buffer, size_t size)
+{
+	const uint8_t* p = (const uint8_t*)buffer;
+	while (size > 0)
+	{
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+bool GatewayReadFrame(int fd, std::vector<uint8_t>& frame, uint32_t maxSize)
+{
+	uint8_t prefix[4];
+	if (!GatewayReadExact(fd, prefix, sizeof(prefix)))
+		return false;
+
+	uint32_t size = GatewayProtocol::get(prefix, 4);
+	if (size > maxSize)
+		return false;
+
+	frame.resize(size);
+	return GatewayReadExact(fd, frame.data(), size);
+}
+
+void GatewayClose(int fd)
+{
+	if (fd >= 0)
+		close(fd);
+}
+
+void GatewayShutdown(int fd)
+{
+	if (fd >= 0)
+		shutdown(fd, SHUT_RD);
+}
+
+void GatewayFinishSending(int fd)
+{
+	if (fd >= 0)
+		shutdown(fd, SHUT_WR);
+}
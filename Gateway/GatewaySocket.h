@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+*  Subject: GatewaySocket
+*  Purpose: Blocking Unix and TCP socket helpers for paging gateway and its clients. POSIX only.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//Address is unix:/path/to/socket, tcp:host:port or tcp:port (all interfaces). Both throw on failure.
+int GatewayListen(const std::string& address);
+int GatewayConnect(const std::string& address);
+
+int GatewayAccept(int listenFd); //-1 if nothing to accept
+bool GatewayWaitReadable(int fd, int timeoutMs);
+
+//False on error or closed connection
+bool GatewayReadExact(int fd, void* buffer, size_t size);
+bool GatewayWriteAll(int fd, const void* buffer, size_t size);
+bool GatewayReadFrame(int fd, std::vector<uint8_t>& frame, uint32_t maxSize); //Frame without size prefix
+
+void GatewayClose(int fd);
+void GatewayShutdown(int fd); //Stops receiving, blocked reads return. Sending still works.
+void GatewayFinishSending(int fd); //Peer reads end of stream, receiving still works
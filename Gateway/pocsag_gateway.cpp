@@ -0,0 +1,792 @@
+/*
+*  Subject: pocsag_gateway
+*  Purpose: Paging gateway. Takes page requests from Unix and TCP sockets, encodes batches on worker pool and feeds shared transmitter.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "GatewayProtocol.h"
+#include "GatewaySocket.h"
+#include "POCSAG.h"
+#include "HackRF_PCMSource.h"
+#include "HackRF_VirtualDevice.h"
+#include "HackRFTransmitter.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+//Requests are collected for a short window and every batch becomes one multi-page transmission.
+//Batches are encoded in parallel, but pushed to transmitter strictly in order of arrival. Requests of one window with
+//different bitrates go in batch per bitrate, batches are in order of their first requests.
+//Protocol is described in GatewayProtocol.h
+
+using Clock = std::chrono::steady_clock;
+using namespace GatewayProtocol;
+
+constexpr double INITIAL_SECONDS_PER_PAGE = 0.25; //Short alphanumeric page in 64 page batch at 1200 bps, until real value is known
+
+struct Options
+{
+	std::vector<std::string> listen;
+	uint64_t frequency = 0;
+	float gainRF = 0;
+	bool amp = false;
+	double deviationKHz = 4.5;
+	uint32_t pcmSampleRate = 48000;
+	uint32_t samplesPerBit = 0;				//Minimum sample rate encoding at bps * samplesPerBit if not 0
+	uint32_t deviceSampleRate = 2000000;	//0 to follow PCM sample rate
+	std::string device = "hackrf";			//hackrf, null or file:PATH
+	size_t workers = std::max(1u, std::thread::hardware_concurrency() / 2);
+	uint32_t batchWindowMs = 10;			//How long to collect requests after the first one before encoding
+	size_t maxBatch = 64;					//Max pages in one transmission
+	double maxBacklogSeconds = 600;			//Requests are rejected while queued air time is longer
+	uint32_t statsSeconds = 60;				//0 to disable periodic stats
+};
+
+static std::atomic<bool> stopRequested(false);
+
+static void onSignal(int)
+{
+	stopRequested = true;
+}
+
+static void log(const std::string& line)
+{
+	auto now = std::chrono::system_clock::now();
+	auto time_t_now = std::chrono::system_clock::to_time_t(now);
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+	std::tm tm_now;
+	localtime_r(&time_t_now, &tm_now);
+
+	std::ostringstream oss;
+	oss << std::put_time(&tm_now, "%Y-%m-%d %H:%M:%S") << "." << std::setw(3) << std::setfill('0') << ms << " " << line << "\n";
+	std::cerr << oss.str() << std::flush;
+}
+
+static uint32_t toMs(double seconds)
+{
+	return (uint32_t)std::max(0.0, seconds * 1000.0 + 0.5);
+}
+
+class Connection
+{
+private:
+	int m_fd;
+	std::mutex m_sendMutex;
+
+public:
+	explicit Connection(int fd) : m_fd(fd) {}
+	~Connection() { GatewayClose(m_fd); }
+
+	int Fd() const { return m_fd; }
+
+	//Acks of one batch are sent with one write
+	void Send(const std::vector<Ack>& acks)
+	{
+		std::vector<uint8_t> buf;
+		for (const auto& ack : acks)
+			Write(buf, ack);
+
+		std::lock_guard<std::mutex> lock(m_sendMutex);
+		if (!GatewayWriteAll(m_fd, buf.data(), buf.size()))
+			GatewayShutdown(m_fd); //Client is gone, reader will notice
+	}
+};
+
+using ConnectionPtr = std::shared_ptr<Connection>;
+
+struct Pending
+{
+	uint32_t id;
+	POCSAG::Page page;
+	POCSAG::BPS bps;
+	ConnectionPtr connection;
+	Clock::time_point receivedAt;
+};
+
+struct Batch
+{
+	uint64_t seq = 0;
+	POCSAG::BPS bps = POCSAG::BPS::BPS_1200;
+	std::vector<Pending> items;
+	std::vector<std::string> errors;	//Empty if page is encoded
+	std::vector<float> samples;
+	double airtime = 0;
+	double encodeSeconds = 0;
+};
+
+struct Stats
+{
+	size_t requests = 0;
+	size_t queued = 0;
+	size_t rejected = 0;
+	size_t batches = 0;
+	double airSeconds = 0;
+	double encodeSeconds = 0;
+	double ackLatencySum = 0;
+	double ackLatencyMax = 0;
+	Clock::time_point since = Clock::now();
+};
+
+class Gateway
+{
+private:
+	const Options& m_opts;
+	HackRFTransmitter& m_tx;
+	const POCSAG::Encoder m_encoder; //Shared by workers through const API, so it's settings are never changed
+
+	//Requests waiting for batcher
+	std::mutex m_intakeMutex;
+	std::condition_variable m_intakeCv;
+	std::deque<Pending> m_intake;
+	bool m_intakeClosed = false;
+
+	//Batches waiting for encoder
+	std::mutex m_workMutex;
+	std::condition_variable m_workCv;
+	std::deque<Batch> m_work;
+	bool m_workClosed = false;
+
+	//Encoded batches waiting for their turn to be pushed
+	std::mutex m_pushMutex;
+	std::map<uint64_t, Batch> m_encoded;
+	uint64_t m_nextPush = 0;
+	Clock::time_point m_txEnd;									//Projected end of everything pushed to transmitter
+	std::deque<std::pair<Clock::time_point, size_t>> m_onAir;	//End time and page count of pushed transmissions
+	std::atomic<Clock::rep> m_backlogEnd;						//m_txEnd for readers
+	std::atomic<size_t> m_pendingPages;							//Submitted, but not pushed yet
+	std::atomic<double> m_secondsPerPage;						//Air time per page of the last pushed batch
+
+	std::mutex m_statsMutex;
+	Stats m_stats;
+
+	std::thread m_batcher;
+	std::vector<std::thread> m_workers;
+
+	void _batcherThread();
+	void _workerThread();
+	void _encode(POCSAG::Encoder::Workspace_t& ws, std::vector<POCSAG::Page>& pages, Batch& batch);
+	void _complete(Batch&& batch);
+	void _push(Batch& batch, std::map<Connection*, std::pair<ConnectionPtr, std::vector<Ack>>>& acks);
+
+public:
+	Gateway(const Options& opts, HackRFTransmitter& tx);
+	~Gateway();
+
+	void Submit(Pending&& pending);
+	double BacklogSeconds() const;
+	void Drain(); //Encodes and pushes everything submitted, no more requests are accepted after it
+	void PrintStats();
+	Clock::time_point GetTxEnd();
+};
+
+Gateway::Gateway(const Options& opts, HackRFTransmitter& tx)
+	: m_opts(opts)
+	, m_tx(tx)
+	, m_encoder(8, opts.pcmSampleRate, opts.samplesPerBit)
+	, m_txEnd(Clock::now())
+	, m_backlogEnd(Clock::now().time_since_epoch().count())
+	, m_pendingPages(0)
+	, m_secondsPerPage(INITIAL_SECONDS_PER_PAGE)
+{
+	m_batcher = std::thread(&Gateway::_batcherThread, this);
+	for (size_t i = 0; i < m_opts.workers; i++)
+		m_workers.emplace_back(&Gateway::_workerThread, this);
+}
+
+Gateway::~Gateway()
+{
+	Drain();
+}
+
+void Gateway::Submit(Pending&& pending)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_intakeMutex);
+		m_intake.push_back(std::move(pending));
+	}
+	m_intakeCv.notify_one();
+	m_pendingPages++;
+
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats.requests++;
+}
+
+//Pushed air time plus estimate for requests which are not encoded yet, otherwise burst of requests would pass the limit
+double Gateway::BacklogSeconds() const
+{
+	Clock::time_point end{ Clock::duration(m_backlogEnd.load(std::memory_order_relaxed)) };
+	double pushed = std::max(0.0, std::chrono::duration<double>(end - Clock::now()).count());
+	return pushed + m_pendingPages * m_secondsPerPage;
+}
+
+void Gateway::Drain()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_intakeMutex);
+		m_intakeClosed = true;
+	}
+	m_intakeCv.notify_all();
+
+	if (m_batcher.joinable())
+		m_batcher.join();
+	for (auto& worker : m_workers)
+		worker.join();
+	m_workers.clear();
+}
+
+Clock::time_point Gateway::GetTxEnd()
+{
+	std::lock_guard<std::mutex> lock(m_pushMutex);
+	return m_txEnd;
+}
+
+void Gateway::_batcherThread()
+{
+	uint64_t seq = 0;
+	std::unique_lock<std::mutex> lock(m_intakeMutex);
+	while (true)
+	{
+		m_intakeCv.wait(lock, [&]() { return !m_intake.empty() || m_intakeClosed; });
+		if (m_intake.empty())
+			break;
+
+		auto deadline = m_intake.front().receivedAt + std::chrono::milliseconds(m_opts.batchWindowMs);
+		m_intakeCv.wait_until(lock, deadline, [&]() { return m_intake.size() >= m_opts.maxBatch || m_intakeClosed; });
+
+		//Multi-page transmission has one bitrate, so requests are split by it keeping their order.
+		//Batches are in order of their first request, so earlier request of other bitrate isn't sent after later ones.
+		std::vector<Batch> byRate;
+		size_t count = std::min(m_opts.maxBatch, m_intake.size());
+		for (size_t i = 0; i < count; i++)
+		{
+			Pending& p = m_intake.front();
+			auto it = std::find_if(byRate.begin(), byRate.end(), [&p](const Batch& b) { return b.bps == p.bps; });
+			if (it == byRate.end())
+			{
+				byRate.emplace_back();
+				byRate.back().bps = p.bps;
+				it = byRate.end() - 1;
+			}
+			it->items.push_back(std::move(p));
+			m_intake.pop_front();
+		}
+		lock.unlock();
+
+		{
+			std::lock_guard<std::mutex> workLock(m_workMutex);
+			for (auto& batch : byRate)
+			{
+				batch.seq = seq++;
+				m_work.push_back(std::move(batch));
+			}
+		}
+		m_workCv.notify_all();
+		lock.lock();
+	}
+
+	{
+		std::lock_guard<std::mutex> workLock(m_workMutex);
+		m_workClosed = true;
+	}
+	m_workCv.notify_all();
+}
+
+void Gateway::_workerThread()
+{
+	//Every worker has it's own encoder workspace. Workspace and pages keep their buffers between batches.
+	POCSAG::Encoder::Workspace_t ws;
+	std::vector<POCSAG::Page> pages;
+	size_t lastSampleCount = 0;
+	while (true)
+	{
+		Batch batch;
+		{
+			std::unique_lock<std::mutex> lock(m_workMutex);
+			m_workCv.wait(lock, [&]() { return !m_work.empty() || m_workClosed; });
+			if (m_work.empty())
+				return;
+			batch = std::move(m_work.front());
+			m_work.pop_front();
+		}
+
+		//Storage of transmitted batches comes back through pool
+		auto start = Clock::now();
+		batch.samples = HackRF_ChunkPool::Take(lastSampleCount);
+		_encode(ws, pages, batch);
+		lastSampleCount = batch.samples.size();
+		batch.encodeSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+		_complete(std::move(batch));
+	}
+}
+
+void Gateway::_encode(POCSAG::Encoder::Workspace_t& ws, std::vector<POCSAG::Page>& pages, Batch& batch)
+{
+	batch.errors.assign(batch.items.size(), std::string());
+
+	//Assignment reuses strings of previous batch
+	pages.resize(batch.items.size());
+	for (size_t i = 0; i < batch.items.size(); i++)
+		pages[i] = batch.items[i].page;
+
+	//Exact size is known before encoding, so pooled buffer is filled in place
+	POCSAG::TransmissionStats txStats;
+	try
+	{
+		batch.samples.resize(m_encoder.prepare(ws, pages, batch.bps, POCSAG::Output::Samples, &txStats));
+		m_encoder.encodeInto(ws, std::span<float>(batch.samples));
+		batch.airtime = txStats.airtimeSec;
+		return;
+	}
+	catch (const std::exception&)
+	{
+		//Find bad pages with cheap layout of single page, then encode the rest again
+	}
+
+	pages.clear();
+	for (size_t i = 0; i < batch.items.size(); i++)
+	{
+		const auto& page = batch.items[i].page;
+		try
+		{
+			m_encoder.prepare(ws, page, batch.bps, POCSAG::Output::Raw);
+			pages.push_back(page);
+		}
+		catch (const std::exception& ex)
+		{
+			batch.errors[i] = ex.what();
+		}
+	}
+
+	batch.samples.clear();
+	batch.airtime = 0;
+	if (pages.empty())
+		return;
+
+	try
+	{
+		batch.samples.resize(m_encoder.prepare(ws, pages, batch.bps, POCSAG::Output::Samples, &txStats));
+		m_encoder.encodeInto(ws, std::span<float>(batch.samples));
+		batch.airtime = txStats.airtimeSec;
+	}
+	catch (const std::exception& ex)
+	{
+		for (auto& error : batch.errors)
+		{
+			if (error.empty())
+				error = ex.what();
+		}
+	}
+}
+
+void Gateway::_complete(Batch&& batch)
+{
+	std::map<Connection*, std::pair<ConnectionPtr, std::vector<Ack>>> acks;
+	{
+		std::lock_guard<std::mutex> lock(m_pushMutex);
+		m_encoded.emplace(batch.seq, std::move(batch));
+
+		//Push every batch which is next in order, even if it was encoded by another worker
+		for (auto it = m_encoded.find(m_nextPush); it != m_encoded.end(); it = m_encoded.find(m_nextPush))
+		{
+			_push(it->second, acks);
+			m_encoded.erase(it);
+			m_nextPush++;
+		}
+	}
+
+	//Sockets may block, so acks are sent without holding the lock
+	for (auto& [ptr, entry] : acks)
+		entry.first->Send(entry.second);
+}
+
+void Gateway::_push(Batch& batch, std::map<Connection*, std::pair<ConnectionPtr, std::vector<Ack>>>& acks)
+{
+	auto now = Clock::now();
+	while (!m_onAir.empty() && m_onAir.front().first <= now)
+		m_onAir.pop_front();
+
+	size_t position = 0;
+	for (const auto& [end, pages] : m_onAir)
+		position += pages;
+
+	size_t queued = 0;
+	if (!batch.samples.empty())
+	{
+		m_tx.PushSamples(HackRF_PCMSource(std::move(batch.samples), m_encoder.GetSampleRate(batch.bps)));
+		m_txEnd = std::max(m_txEnd, now) + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(batch.airtime));
+		m_backlogEnd.store(m_txEnd.time_since_epoch().count(), std::memory_order_relaxed);
+		for (const auto& error : batch.errors)
+			queued += error.empty() ? 1 : 0;
+		m_onAir.emplace_back(m_txEnd, queued);
+		m_secondsPerPage = batch.airtime / queued;
+	}
+	m_pendingPages -= batch.items.size();
+
+	uint32_t etaMs = toMs(std::chrono::duration<double>(m_txEnd - now).count());
+	double latencyMax = 0, latencySum = 0;
+	for (size_t i = 0; i < batch.items.size(); i++)
+	{
+		const auto& item = batch.items[i];
+		Ack ack;
+		ack.id = item.id;
+		if (batch.errors[i].empty())
+		{
+			ack.status = Status::Queued;
+			ack.queuePosition = (uint32_t)position++;
+			ack.airtimeMs = toMs(batch.airtime);
+			ack.etaMs = etaMs;
+		}
+		else
+		{
+			ack.status = Status::EncodeFailed;
+			ack.error = batch.errors[i];
+		}
+
+		auto& entry = acks[item.connection.get()];
+		entry.first = item.connection;
+		entry.second.push_back(std::move(ack));
+
+		double latency = std::chrono::duration<double>(now - item.receivedAt).count();
+		latencySum += latency;
+		latencyMax = std::max(latencyMax, latency);
+	}
+
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats.batches++;
+	m_stats.queued += queued;
+	m_stats.rejected += batch.items.size() - queued;
+	m_stats.airSeconds += batch.airtime;
+	m_stats.encodeSeconds += batch.encodeSeconds;
+	m_stats.ackLatencySum += latencySum;
+	m_stats.ackLatencyMax = std::max(m_stats.ackLatencyMax, latencyMax);
+}
+
+void Gateway::PrintStats()
+{
+	Stats stats;
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		stats = m_stats;
+		m_stats = Stats();
+	}
+
+	size_t acked = stats.queued + stats.rejected;
+	double elapsed = std::chrono::duration<double>(Clock::now() - stats.since).count();
+	std::ostringstream oss;
+	oss << std::fixed << std::setprecision(2)
+		<< "Stats: " << stats.requests << " requests (" << stats.requests / elapsed << "/s), "
+		<< stats.queued << " queued, " << stats.rejected << " failed, "
+		<< stats.batches << " batches (" << (stats.batches ? double(acked) / stats.batches : 0.0) << " pages avg), "
+		<< "encode " << (stats.batches ? 1000.0 * stats.encodeSeconds / stats.batches : 0.0) << " ms/batch, "
+		<< "ack latency avg " << (acked ? 1000.0 * stats.ackLatencySum / acked : 0.0) << " ms max " << 1000.0 * stats.ackLatencyMax << " ms, "
+		<< "air " << stats.airSeconds << " s, backlog " << BacklogSeconds() << " s, "
+		<< "memory " << m_tx.GetMemoryFootprint() / 1024 << " KB";
+	log(oss.str());
+}
+
+static bool validRequest(const Request& r, std::string& error)
+{
+	if (r.type > (uint8_t)POCSAG::Type::Tone)
+		error = "Unknown type";
+	else if (r.bps != 512 && r.bps != 1200 && r.bps != 2400)
+		error = "Bitrate must be 512, 1200 or 2400";
+	else if (r.charset > (uint8_t)POCSAG::Charset::Cyrilic)
+		error = "Unknown charset";
+	else if (r.function > (uint8_t)POCSAG::Function::D)
+		error = "Unknown function";
+	return error.empty();
+}
+
+static void connectionThread(ConnectionPtr connection, Gateway& gateway, const Options& opts, std::shared_ptr<std::atomic<bool>> done)
+{
+	std::vector<uint8_t> frame;
+	while (GatewayReadFrame(connection->Fd(), frame, MAX_FRAME_SIZE))
+	{
+		Request request;
+		Ack ack;
+		std::string error;
+		if (!Read(frame.data(), frame.size(), request))
+		{
+			ack.status = Status::BadRequest;
+			ack.error = "Frame is too short";
+		}
+		else if (!validRequest(request, error))
+		{
+			ack.id = request.id;
+			ack.status = Status::BadRequest;
+			ack.error = error;
+		}
+		else if (stopRequested)
+		{
+			ack.id = request.id;
+			ack.status = Status::ShuttingDown;
+		}
+		else if (gateway.BacklogSeconds() > opts.maxBacklogSeconds)
+		{
+			ack.id = request.id;
+			ack.status = Status::Overloaded;
+			ack.etaMs = toMs(gateway.BacklogSeconds());
+		}
+		else
+		{
+			Pending pending;
+			pending.id = request.id;
+			pending.page.address = request.ric;
+			pending.page.type = POCSAG::Type(request.type);
+			pending.page.message = std::move(request.text);
+			pending.page.charset = POCSAG::Charset(request.charset);
+			pending.page.func = POCSAG::Function(request.function);
+			pending.bps = POCSAG::BPS(request.bps);
+			pending.connection = connection;
+			pending.receivedAt = Clock::now();
+			gateway.Submit(std::move(pending));
+			continue;
+		}
+
+		connection->Send({ ack });
+	}
+
+	*done = true;
+}
+
+//Connection is closed when reader is finished and the last ack is sent
+struct Client
+{
+	std::weak_ptr<Connection> connection;
+	std::thread thread;
+	std::shared_ptr<std::atomic<bool>> done;
+};
+
+static void acceptThread(int listenFd, Gateway& gateway, const Options& opts, std::mutex& clientsMutex, std::list<Client>& clients)
+{
+	while (!stopRequested)
+	{
+		if (!GatewayWaitReadable(listenFd, 200))
+			continue;
+
+		int fd = GatewayAccept(listenFd);
+		if (fd < 0)
+			continue;
+
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		for (auto it = clients.begin(); it != clients.end();)
+		{
+			if (*it->done)
+			{
+				it->thread.join();
+				it = clients.erase(it);
+			}
+			else
+				++it;
+		}
+
+		auto connection = std::make_shared<Connection>(fd);
+		auto done = std::make_shared<std::atomic<bool>>(false);
+		clients.push_back({ connection, std::thread(connectionThread, connection, std::ref(gateway), std::cref(opts), done), done });
+	}
+}
+
+static std::unique_ptr<IHackRFDevice> makeDevice(const std::string& device)
+{
+	if (device == "null")
+		return std::make_unique<HackRF_NullDevice>();
+	if (device.rfind("file:", 0) == 0)
+		return std::make_unique<HackRF_FileDevice>(device.substr(5));
+	if (device == "hackrf")
+		return nullptr; //Default backend of transmitter
+	throw std::runtime_error("Unknown device '" + device + "', expected hackrf, null or file:PATH");
+}
+
+static void usage()
+{
+	std::cerr <<
+		"Usage: pocsag_gateway --listen ADDRESS --frequency HZ [options]\n"
+		"  --listen ADDRESS      unix:PATH, tcp:PORT or tcp:HOST:PORT, may be repeated\n"
+		"  --frequency HZ        Carrier frequency in Hz\n"
+		"  --gain DB             RF gain, 0-47 (default 0)\n"
+		"  --amp                 Enable amplifier\n"
+		"  --deviation KHZ       FM deviation (default 4.5)\n"
+		"  --pcm-rate HZ         Encoder sample rate (default 48000)\n"
+		"  --samples-per-bit N   Encode at bps * N Hz instead of PCM rate, 0 to disable (default 0)\n"
+		"  --sample-rate HZ      Fixed device sample rate, 2-20 MHz or 0 to follow PCM (default 2000000)\n"
+		"  --device DEV          hackrf, null or file:PATH.cs8 (default hackrf)\n"
+		"  --workers N           Encoder threads (default half of CPU threads)\n"
+		"  --batch-window MS     Collect requests for this long before encoding (default 10)\n"
+		"  --max-batch N         Max pages in one transmission (default 64)\n"
+		"  --max-backlog SECONDS Reject requests while queued air time is longer (default 600)\n"
+		"  --stats SECONDS       Stats interval, 0 to disable (default 60)\n";
+}
+
+static Options parseArgs(int argc, char* argv[])
+{
+	Options opts;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		auto value = [&]() -> std::string
+		{
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value of " + arg);
+			return argv[++i];
+		};
+
+		if (arg == "--listen")
+			opts.listen.push_back(value());
+		else if (arg == "--frequency")
+			opts.frequency = std::stoull(value());
+		else if (arg == "--gain")
+			opts.gainRF = std::stof(value());
+		else if (arg == "--amp")
+			opts.amp = true;
+		else if (arg == "--deviation")
+			opts.deviationKHz = std::stod(value());
+		else if (arg == "--pcm-rate")
+			opts.pcmSampleRate = (uint32_t)std::stoul(value());
+		else if (arg == "--samples-per-bit")
+			opts.samplesPerBit = (uint32_t)std::stoul(value());
+		else if (arg == "--sample-rate")
+			opts.deviceSampleRate = (uint32_t)std::stoul(value());
+		else if (arg == "--device")
+			opts.device = value();
+		else if (arg == "--workers")
+			opts.workers = std::max<size_t>(1, std::stoul(value()));
+		else if (arg == "--batch-window")
+			opts.batchWindowMs = (uint32_t)std::stoul(value());
+		else if (arg == "--max-batch")
+			opts.maxBatch = std::max<size_t>(1, std::stoul(value()));
+		else if (arg == "--max-backlog")
+			opts.maxBacklogSeconds = std::stod(value());
+		else if (arg == "--stats")
+			opts.statsSeconds = (uint32_t)std::stoul(value());
+		else if (arg == "--help" || arg == "-h")
+		{
+			usage();
+			exit(0);
+		}
+		else
+			throw std::runtime_error("Unknown option " + arg);
+	}
+
+	if (opts.listen.empty())
+		throw std::runtime_error("No address to listen on");
+	if (opts.frequency == 0)
+		throw std::runtime_error("Frequency is not set");
+	return opts;
+}
+
+int main(int argc, char* argv[])
+{
+	Options opts;
+	try
+	{
+		opts = parseArgs(argc, argv);
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << "\n";
+		usage();
+		return 2;
+	}
+
+	std::signal(SIGINT, onSignal);
+	std::signal(SIGTERM, onSignal);
+	std::signal(SIGPIPE, SIG_IGN);
+
+	std::vector<int> listeners;
+	try
+	{
+		auto device = makeDevice(opts.device);
+		HackRFTransmitter tx = device ? HackRFTransmitter(std::move(device)) : HackRFTransmitter();
+		tx.SetFrequency(opts.frequency);
+		tx.SetGainRF(opts.gainRF);
+		tx.SetAMP(opts.amp);
+		tx.SetFMDeviationKHz(opts.deviationKHz);
+		tx.SetFixedDeviceSampleRate(opts.deviceSampleRate);
+		tx.SetTurnOffTXWhenIdle(true); //Radio is on air only while there is something to send
+		if (!tx.StartTX())
+			throw std::runtime_error("Failed to start TX");
+
+		for (const auto& address : opts.listen)
+			listeners.push_back(GatewayListen(address));
+
+		Gateway gateway(opts, tx);
+		std::mutex clientsMutex;
+		std::list<Client> clients;
+		std::vector<std::thread> acceptors;
+		for (int fd : listeners)
+			acceptors.emplace_back(acceptThread, fd, std::ref(gateway), std::cref(opts), std::ref(clientsMutex), std::ref(clients));
+
+		std::ostringstream started;
+		started << "Started on " << opts.frequency << " Hz, device " << opts.device << ", " << opts.workers << " workers, listening";
+		for (const auto& address : opts.listen)
+			started << " " << address;
+		log(started.str());
+
+		auto nextStats = Clock::now() + std::chrono::seconds(opts.statsSeconds);
+		while (!stopRequested)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (opts.statsSeconds && Clock::now() >= nextStats)
+			{
+				gateway.PrintStats();
+				nextStats = Clock::now() + std::chrono::seconds(opts.statsSeconds);
+			}
+		}
+
+		//Stop taking requests, then ack everything already received
+		log("Stop requested, finishing queued requests");
+		std::signal(SIGINT, SIG_DFL);
+		std::signal(SIGTERM, SIG_DFL);
+		for (auto& acceptor : acceptors)
+			acceptor.join();
+		for (auto& client : clients)
+		{
+			if (auto connection = client.connection.lock())
+				GatewayShutdown(connection->Fd());
+		}
+		for (auto& client : clients)
+			client.thread.join();
+		gateway.Drain();
+
+		auto left = gateway.GetTxEnd() - Clock::now();
+		tx.WaitForIdle(std::chrono::duration_cast<std::chrono::milliseconds>(left) + std::chrono::seconds(5));
+		tx.StopTX();
+
+		if (opts.statsSeconds)
+			gateway.PrintStats();
+		log("Stopped");
+	}
+	catch (const std::exception& ex)
+	{
+		log(std::string("Error: ") + ex.what());
+		for (int fd : listeners)
+			GatewayClose(fd);
+		return 1;
+	}
+
+	for (int fd : listeners)
+		GatewayClose(fd);
+	for (const auto& address : opts.listen)
+	{
+		if (address.rfind("unix:", 0) == 0)
+			std::remove(address.substr(5).c_str());
+	}
+	return 0;
+}
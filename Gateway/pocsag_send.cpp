@@ -0,0 +1,254 @@
+/*
+*  Subject: pocsag_send
+*  Purpose: Client of paging gateway. Sends pages from stdin or floods gateway with generated pages to measure it.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "GatewayProtocol.h"
+#include "GatewaySocket.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cctype>
+
+//Input line: RIC type[:FUNC] message, same as pocsagd reads. Every ack is printed to stdout.
+
+using Clock = std::chrono::steady_clock;
+using namespace GatewayProtocol;
+
+static const char* statusName(Status status)
+{
+	switch (status)
+	{
+	case Status::Queued:		return "queued";
+	case Status::BadRequest:	return "bad-request";
+	case Status::EncodeFailed:	return "encode-failed";
+	case Status::Overloaded:	return "overloaded";
+	case Status::ShuttingDown:	return "shutting-down";
+	}
+	return "unknown";
+}
+
+static bool parseLine(const std::string& line, Request& r)
+{
+	std::istringstream iss(line);
+	std::string ric, type;
+	if (line.empty() || line[0] == '#' || !(iss >> ric >> type))
+		return false;
+
+	if (ric.size() > 7 || ric.find_first_not_of("0123456789") != std::string::npos)
+		throw std::runtime_error("Invalid RIC '" + ric + "'");
+	r.ric = (uint32_t)std::stoul(ric);
+
+	r.function = 0;
+	size_t colon = type.find(':');
+	if (colon != std::string::npos)
+	{
+		char func = (char)std::tolower((unsigned char)type[colon + 1]);
+		if (type.size() != colon + 2 || func < 'a' || func > 'd')
+			throw std::runtime_error("Invalid function in '" + type + "'");
+		r.function = uint8_t(func - 'a');
+		type = type.substr(0, colon);
+	}
+
+	if (type == "a" || type == "alpha")
+		r.type = 1;
+	else if (type == "n" || type == "numeric")
+		r.type = 0;
+	else if (type == "t" || type == "tone")
+		r.type = 2;
+	else
+		throw std::runtime_error("Invalid type '" + type + "'");
+
+	std::getline(iss >> std::ws, r.text);
+	return true;
+}
+
+static void usage()
+{
+	std::cerr <<
+		"Usage: pocsag_send --connect ADDRESS [options]\n"
+		"  --connect ADDRESS     unix:PATH or tcp:HOST:PORT of gateway\n"
+		"  --bps 512|1200|2400   Bitrate of pages (default 1200)\n"
+		"  --charset N           0 raw, 1 latin, 2 cyrillic (default 1)\n"
+		"  --flood N             Send N generated pages and print latency summary\n"
+		"  --rate R              Pages per second for --flood (default as fast as possible)\n";
+}
+
+int main(int argc, char* argv[])
+{
+	std::string address;
+	uint16_t bps = 1200;
+	uint8_t charset = 1;
+	size_t flood = 0;
+	double rate = 0;
+
+	try
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value of " + arg);
+			std::string value = argv[++i];
+
+			if (arg == "--connect")
+				address = value;
+			else if (arg == "--bps")
+				bps = (uint16_t)std::stoul(value);
+			else if (arg == "--charset")
+				charset = (uint8_t)std::stoul(value);
+			else if (arg == "--flood")
+				flood = std::stoul(value);
+			else if (arg == "--rate")
+				rate = std::stod(value);
+			else
+				throw std::runtime_error("Unknown option " + arg);
+		}
+
+		if (address.empty())
+			throw std::runtime_error("Gateway address is not set");
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << "\n";
+		usage();
+		return 2;
+	}
+
+	int fd = -1;
+	try
+	{
+		fd = GatewayConnect(address);
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << "\n";
+		return 1;
+	}
+
+	//Send time of every request by id, read by ack thread
+	std::vector<Clock::time_point> sentAt;
+	std::vector<double> latencies;
+	size_t statusCount[5] = {};
+	std::mutex mutex;
+	size_t sent = 0;
+
+	if (flood)
+		sentAt.resize(flood);
+
+	std::thread acks([&]()
+	{
+		std::vector<uint8_t> frame;
+		while (GatewayReadFrame(fd, frame, MAX_FRAME_SIZE))
+		{
+			Ack ack;
+			if (!Read(frame.data(), frame.size(), ack))
+				break;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if ((size_t)ack.status < 5)
+				statusCount[(size_t)ack.status]++;
+
+			if (flood)
+			{
+				if (ack.id < sentAt.size())
+					latencies.push_back(std::chrono::duration<double>(Clock::now() - sentAt[ack.id]).count());
+				continue;
+			}
+
+			std::cout << ack.id << " " << statusName(ack.status) << " position " << ack.queuePosition << " air " << ack.airtimeMs
+				<< " ms eta " << ack.etaMs << " ms" << (ack.error.empty() ? "" : " " + ack.error) << std::endl;
+		}
+	});
+
+	auto start = Clock::now();
+	std::vector<uint8_t> buf;
+	if (flood)
+	{
+		const char* words[] = { "Unit", "respond", "to", "alarm", "at", "building", "floor", "room", "code", "red" };
+		for (size_t i = 0; i < flood; i++)
+		{
+			Request r;
+			r.id = (uint32_t)i;
+			r.ric = 1000000 + (uint32_t)(i * 7919 % 1000000);
+			r.type = 1;
+			r.bps = bps;
+			r.charset = charset;
+			r.text = std::string(words[i % 10]) + " " + words[(i / 10) % 10] + " " + std::to_string(i);
+			Write(buf, r);
+
+			//Paced flood sends every page on time, otherwise frames are sent in large writes
+			if (rate > 0)
+				std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(i / rate)));
+			if (rate > 0 || buf.size() > 16384 || i + 1 == flood)
+			{
+				auto now = Clock::now();
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					for (size_t j = sent; j <= i; j++)
+						sentAt[j] = now;
+				}
+				if (!GatewayWriteAll(fd, buf.data(), buf.size()))
+					break;
+				sent = i + 1;
+				buf.clear();
+			}
+		}
+	}
+	else
+	{
+		std::string line;
+		uint32_t id = 0;
+		while (std::getline(std::cin, line))
+		{
+			Request r;
+			r.bps = bps;
+			r.charset = charset;
+			try
+			{
+				if (!parseLine(line, r))
+					continue;
+			}
+			catch (const std::exception& ex)
+			{
+				std::cerr << "Skipped line: " << ex.what() << "\n";
+				continue;
+			}
+
+			r.id = id++;
+			buf.clear();
+			Write(buf, r);
+			if (!GatewayWriteAll(fd, buf.data(), buf.size()))
+				break;
+			sent++;
+		}
+	}
+
+	//Gateway closes connection after the last ack
+	GatewayFinishSending(fd);
+	acks.join();
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	GatewayClose(fd);
+
+	if (flood)
+	{
+		std::sort(latencies.begin(), latencies.end());
+		auto percentile = [&](double p) { return latencies.empty() ? 0.0 : 1000.0 * latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))]; };
+		std::cout << std::fixed << std::setprecision(2)
+			<< "Sent " << sent << ", acked " << latencies.size() << " in " << elapsed << " s (" << latencies.size() / elapsed << " req/s)\n"
+			<< "Queued " << statusCount[0] << ", bad " << statusCount[1] << ", failed " << statusCount[2] << ", overloaded " << statusCount[3] << "\n"
+			<< "Ack latency p50 " << percentile(0.5) << " ms, p99 " << percentile(0.99) << " ms, max " << percentile(1.0) << " ms\n";
+	}
+
+	return statusCount[0] == sent ? 0 : 1;
+}
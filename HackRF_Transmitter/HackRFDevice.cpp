@@ -84,7 +84,7 @@ bool HackRFDevice::StopTx()
 	}
 
 	mRunning = false;
-	return mRunning;
+	return true;
 }
 
 void HackRFDevice::SetFrequency(uint64_t freg)
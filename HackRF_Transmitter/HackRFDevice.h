@@ -10,14 +10,14 @@
 *  Comment: Free to use if you credit me in your project.
 */
 
-#include "IHackRFData.h"
+#include "IHackRFDevice.h"
 #include <hackrf.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <atomic>
 
-//This class is incapsulated into HackRFTransmitter so you don't have to use it at all.
-class HackRFDevice
+//Real radio backend. It is created by HackRFTransmitter by default so you don't have to use it at all.
+class HackRFDevice : public IHackRFDevice
 {
 private:
 	hackrf_device *_dev;
@@ -30,13 +30,13 @@ public:
 
 public:
 	int HackRFCallback(int8_t* buffer, uint32_t length);
-	bool Open(IHackRFData *handler);
-	void SetFrequency(uint64_t freg);
-	void SetGain(float gain);
-	void SetAMP(bool enableamp);
-	void SetSampleRate(uint32_t sample_rate);
-	bool StartTx();
-	bool StopTx();
-	void Close();
-	bool IsRunning() const;
+	bool Open(IHackRFData *handler) override;
+	void SetFrequency(uint64_t freg) override;
+	void SetGain(float gain) override;
+	void SetAMP(bool enableamp) override;
+	void SetSampleRate(uint32_t sample_rate) override;
+	bool StartTx() override;
+	bool StopTx() override;
+	void Close() override;
+	bool IsRunning() const override;
 };
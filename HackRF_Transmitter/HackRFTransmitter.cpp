@@ -9,17 +9,50 @@
 */
 
 #include "HackRFTransmitter.h"
+#ifndef HACKRF_NO_LIBHACKRF
+#include "HackRFDevice.h"
+#endif
+#include <algorithm>
 
-constexpr uint32_t BUF_NUM			= 256;
 constexpr uint32_t BYTES_PER_SAMPLE	= 2;
-constexpr double M_PI					= 3.14159265358979323846;
-constexpr uint32_t BUF_LEN			= 262144;         //hackrf tx buf
+constexpr uint32_t SUBCHUNK_BUFS		= BYTES_PER_SAMPLE; //Subchunk is m_bufLen I/Q pairs, so it takes 2 tx bufs
+constexpr uint32_t FSK_SAMPLE_RATE	= 2000000;        //Device sample rate for FSK chunks if it wasn't set by PCM chunks
+constexpr uint32_t MIN_SAMPLE_RATE	= 2000000;
+constexpr uint32_t MAX_SAMPLE_RATE	= 20000000;
+constexpr size_t STREAM_MIN_READ		= 256;            //Samples, smallest read from stream
 
 using namespace std::chrono_literals;
 
+static std::unique_ptr<IHackRFDevice> makeDefaultDevice()
+{
+#ifdef HACKRF_NO_LIBHACKRF
+	throw std::runtime_error("Built without libhackrf, pass a virtual device to HackRFTransmitter.");
+#else
+	return std::make_unique<HackRFDevice>();
+#endif
+}
+
 HackRFTransmitter::HackRFTransmitter(float localGain)
-	: m_localGain(localGain / (float)100.0)
-	, m_ready(false)
+	: HackRFTransmitter(Config(), localGain)
+{
+}
+
+HackRFTransmitter::HackRFTransmitter(const Config& config, float localGain)
+	: HackRFTransmitter(makeDefaultDevice(), config, localGain)
+{
+}
+
+HackRFTransmitter::HackRFTransmitter(std::unique_ptr<IHackRFDevice> device, float localGain)
+	: HackRFTransmitter(std::move(device), Config(), localGain)
+{
+}
+
+HackRFTransmitter::HackRFTransmitter(std::unique_ptr<IHackRFDevice> device, const Config& config, float localGain)
+	: m_config(config)
+	, m_device(std::move(device))
+	, m_ring(config.ringSlots, config.transferSize)
+	, m_bufLen((uint32_t)config.transferSize)
+	, m_localGain(localGain / (float)100.0)
 	, m_FM_phase(0)
 	, m_queueThread(nullptr)
 	, m_stop(true)
@@ -27,26 +60,33 @@ HackRFTransmitter::HackRFTransmitter(float localGain)
 	, m_pcmSampleRate(0)
 	, m_TX_On(false)
 {
-	memset(m_last_in_samples, 0, sizeof(m_last_in_samples));
-	
-	m_leftToSend = m_tail = m_head = 0;
+	if (m_config.ringSlots < SUBCHUNK_BUFS || m_config.transferSize == 0 || m_config.transferSize % BYTES_PER_SAMPLE != 0)
+		throw std::runtime_error("Invalid transmitter config: need at least 2 tx bufs of even size.");
 
-	m_workerBuf.resize(BUF_NUM);
-	for (auto& buf : m_workerBuf)
-		buf.resize(BUF_LEN);
-
-	m_sample_count = 0;
-	m_interpolatedBuf.resize(BUF_LEN);
-	m_IQ_buf.resize(BUF_LEN * BYTES_PER_SAMPLE);
+	m_events = 0;
+	m_dspBytes = 0;
+	m_queuedBytes = 0;
 
 	m_subchunkSizeSamples = 2048;
 	m_subchunkOffset = 0;
+	m_streamPos = 0;
+	m_streamLen = 0;
+	m_fskSamplesLeft = 0;
 	m_FMdeviationKHz = 75.0e3;
 	m_AM = false;
 	m_noIdleTx = false;
 	m_hackrf_sample = 0;
-
-	if (!m_device.Open(this))
+	m_fixedSampleRate = 0;
+	m_resampleRatio = 0;
+	m_dither = false;
+	m_ditherState = 1;
+	m_nextHandle = 1;
+	m_currentHandle = 0;
+	m_currentPriority = Priority::Normal;
+	m_preempt = false;
+	m_abortCurrent = false;
+
+	if (!m_device || !m_device->Open(this))
 		throw std::runtime_error("Failed to open HackRF device.");
 }
 
@@ -55,8 +95,7 @@ HackRFTransmitter::~HackRFTransmitter()
 	if (m_TX_On)
 		StopTX();
 
-	std::lock_guard<std::mutex> lock(m_deviceMutex);
-	m_device.Close();
+	m_device->Close();
 }
 
 void HackRFTransmitter::SetFMDeviationKHz(double value)
@@ -71,25 +110,32 @@ void HackRFTransmitter::SetTurnOffTXWhenIdle(bool off)
 	m_noIdleTx = off;
 }
 
+void HackRFTransmitter::SetDither(bool enable)
+{
+	if (m_TX_On)
+		throw std::runtime_error("Attempting to change dither while transmission is active");
+	m_dither = enable;
+}
+
 void HackRFTransmitter::SetFrequency(uint64_t mhz, uint64_t khz, uint64_t hz)
 {
 	if (m_TX_On)
 		throw std::runtime_error("Attempting to change TX frequency while transmission is active");
-	m_device.SetFrequency((mhz * 1000000) + (khz * 1000) + hz);
+	m_device->SetFrequency((mhz * 1000000) + (khz * 1000) + hz);
 }
 
 void HackRFTransmitter::SetFrequency(uint64_t hz)
 {
 	if (m_TX_On)
 		throw std::runtime_error("Attempting to change TX frequency while transmission is active");
-	m_device.SetFrequency(hz);
+	m_device->SetFrequency(hz);
 }
 
 void HackRFTransmitter::SetGainRF(float gain)
 {
 	if (m_TX_On)
 		throw std::runtime_error("Attempting to change TX gain while transmission is active");
-	m_device.SetGain(gain);
+	m_device->SetGain(gain);
 }
 
 void HackRFTransmitter::SetLocalGain(float gain)
@@ -103,19 +149,39 @@ void HackRFTransmitter::SetAMP(bool enableamp)
 {
 	if (m_TX_On)
 		throw std::runtime_error("Attempting to change TX amp while transmission is active");
-	m_device.SetAMP(enableamp);
+	m_device->SetAMP(enableamp);
 }
 
 void HackRFTransmitter::Clear()
 {
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	for (size_t lane = 0; lane < PRIORITY_LANES; lane++)
+	{
+		m_laneCounters[lane].cancelled += m_lanes[lane].size();
+		m_lanes[lane].clear();
+	}
+	m_queuedBytes = 0;
+
+	//Worker owns current chunk while TX is active. Tx bufs which are already modulated are still sent.
 	if (m_TX_On)
-		throw std::runtime_error("Attempting to clear queue while transmission is active");
+	{
+		if (m_currentHandle != 0)
+		{
+			m_laneCounters[(size_t)m_currentPriority].cancelled++;
+			m_abortCurrent = true;
+			m_preempt = true;
+		}
+		_signal();
+		return;
+	}
 
-	m_currentChunk.clear();
-	while (!m_waveQueue.empty())
-		m_waveQueue.pop();
+	m_currentChunk.Clear();
+	m_currentHandle = 0;
 	m_subchunkOffset = 0;
+	m_fskSamplesLeft = 0;
 	m_FM_phase = 0;
+	m_resampler.Reset();
+	m_ring.Reset();
 }
 
 bool HackRFTransmitter::StartTX()
@@ -123,21 +189,27 @@ bool HackRFTransmitter::StartTX()
 	if (m_TX_On)
 		return false;
 
-	if (m_currentChunk.empty())
+	if (m_currentChunk.Empty())
 	{
 		m_subchunkOffset = 0;
+		m_fskSamplesLeft = 0;
 		m_FM_phase = 0;
 
-		if (!m_waveQueue.empty() && m_pcmSampleRate != 0)
+		if (m_fixedSampleRate != 0)
 		{
-			m_hackrf_sample = uint32_t((m_pcmSampleRate * 1.0 / m_subchunkSizeSamples) * BUF_LEN);
-			m_device.SetSampleRate(m_hackrf_sample);
+			//Only place where device rate is set in fixed rate mode
+			m_hackrf_sample = m_fixedSampleRate;
+			m_device->SetSampleRate(m_hackrf_sample);
+		}
+		else if (!_lanesEmpty() && m_pcmSampleRate != 0)
+		{
+			m_hackrf_sample = _legacySampleRate(m_pcmSampleRate);
+			m_device->SetSampleRate(m_hackrf_sample);
 		}
 	}
 	m_stopped = {};
 	m_started = {};
 	m_stop = false;
-	m_ready = true;
 	m_TX_On = true;
 
 	if (m_queueThread)
@@ -151,81 +223,225 @@ bool HackRFTransmitter::StartTX()
 	return fut.get();
 }
 
-void HackRFTransmitter::_workerThread()
+void HackRFTransmitter::_releaseBuffers()
 {
-	auto& processSubChunk = [&]()
+	if (!m_ring.Empty())
+		return;
+
+	m_ring.Release();
+	if (!m_interpolatedBuf.empty() || !m_streamBuf.empty())
 	{
-		while (!m_stop)
-		{
-			if (!m_ready)
-				continue;
+		std::vector<float>().swap(m_interpolatedBuf);
+		std::vector<float>().swap(m_streamBuf);
+		m_streamPos = 0;
+		m_streamLen = 0;
+		m_dspBytes = 0;
+	}
+}
 
-			if (!m_device.IsRunning()) // Start TX if it is down.
-				m_device.StartTx();
+//Device rate of legacy mode for chunk of given rate. Low PCM rates (minimum sample rate encoding gives a few kHz) would put
+//device below it's lowest rate, then it runs at the lowest one and PCM is resampled to it like in fixed rate mode.
+uint32_t HackRFTransmitter::_legacySampleRate(uint32_t pcmSampleRate) const
+{
+	return std::max(MIN_SAMPLE_RATE, uint32_t((pcmSampleRate * 1.0 / m_subchunkSizeSamples) * m_bufLen));
+}
 
-			_nextSubChunk(); // Transmit the last prepared subchunk.
+bool HackRFTransmitter::_lanesEmpty() const
+{
+	for (const auto& lane : m_lanes)
+	{
+		if (!lane.empty())
+			return false;
+	}
+	return true;
+}
 
-			if (_prepareNext())
-				continue;
+bool HackRFTransmitter::_popChunk()
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	m_currentHandle = 0;
+	m_abortCurrent = false;
 
-			// Stop TX if No-TX when idle feature is enabled and the queue is empty.
-			if (m_noIdleTx && m_waveQueue.empty())
-				m_device.StopTx();
+	ChunkQueue_t* queue = nullptr;
+	for (auto& lane : m_lanes)
+	{
+		if (!lane.empty())
+		{
+			queue = &lane;
 			break;
 		}
+	}
+
+	if (!queue) //When queue is empty and no chunks for TX
+	{
+		m_emptyQueue = true;
+		m_resampleRatio = 0;
+		return false;
+	}
 
-		if (!m_stop) // Clear the current chunk only if not stopped.
-			m_currentChunk.clear();
-	};
+	m_currentChunk = std::move(queue->front()); //Should be faster
+	queue->pop_front();
+	m_queuedBytes -= _chunkBytes(m_currentChunk);
+	m_currentHandle = m_currentChunk.handle;
+	m_currentPriority = m_currentChunk.priority;
 
-	if (!m_device.StartTx()) //Fail and return if we cannot start TX
+	if (!m_currentChunk.started)
+	{
+		auto& counters = m_laneCounters[(size_t)m_currentPriority];
+		double wait = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_currentChunk.queuedAt).count();
+		counters.lastWaitSec = wait;
+		counters.maxWaitSec = std::max(counters.maxWaitSec, wait);
+		counters.totalWaitSec += wait;
+		counters.started++;
+		m_currentChunk.started = true;
+	}
+
+	//Reset FM phase and subchunk offset before transmitting new subchunk of our new chunk
+	m_subchunkOffset = 0;
+	m_streamPos = 0;
+	m_streamLen = 0;
+	m_fskSamplesLeft = 0;
+	m_FM_phase = 0;
+	//Preempted stream continues from input it has read before, with the same rates
+	if (m_currentChunk.resume)
+	{
+		auto& resume = *m_currentChunk.resume;
+		m_streamBuf.swap(resume.buf);
+		m_streamPos = resume.pos;
+		m_streamLen = resume.len;
+		m_resampler = resume.resampler;
+		m_currentChunk.resume.reset();
+		return true;
+	}
+
+	//In legacy mode device rate makes every subchunk of PCM exactly m_bufLen samples long
+	if (m_fixedSampleRate != 0)
+		m_resampler.SetRates(m_currentChunk.sampleRate, m_fixedSampleRate);
+	else if (_legacySampleRate(m_currentChunk.sampleRate) == MIN_SAMPLE_RATE)
+		m_resampler.SetRates(m_currentChunk.sampleRate, MIN_SAMPLE_RATE);
+	else
+		m_resampler.SetRates(m_subchunkSizeSamples, m_bufLen);
+	return true;
+}
+
+void HackRFTransmitter::_preempt()
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	if (m_currentHandle == 0)
+		return;
+
+	if (m_abortCurrent)
+	{
+		m_abortCurrent = false;
+	}
+	else if (m_currentPriority != Priority::Critical && !m_lanes[(size_t)Priority::Critical].empty())
+	{
+		//Preempted PCM and FSK chunk is transmitted again from the beginning, pager can't pick up message from the middle of it.
+		//Stream can't be rewound, it continues where it was.
+		if (m_currentChunk.type == ChunkType::Stream)
+		{
+			auto resume = std::make_shared<StreamResume_t>();
+			resume->buf.swap(m_streamBuf);
+			resume->pos = m_streamPos;
+			resume->len = m_streamLen;
+			resume->resampler = m_resampler;
+			m_currentChunk.resume = std::move(resume);
+		}
+		m_laneCounters[(size_t)m_currentPriority].preempted++;
+		m_queuedBytes += _chunkBytes(m_currentChunk);
+		m_lanes[(size_t)m_currentPriority].push_front(std::move(m_currentChunk));
+	}
+	else
+		return;
+
+	m_currentChunk.Clear();
+	m_currentHandle = 0;
+	m_resampler.Reset();
+}
+
+void HackRFTransmitter::_signal()
+{
+	m_events.fetch_add(1, std::memory_order_release);
+	m_events.notify_one();
+}
+
+void HackRFTransmitter::_notifyState()
+{
+	//Empty lock makes sure waiter either sees the new state or is already waiting for notification
+	{
+		std::lock_guard<std::mutex> lock(m_stateMutex);
+	}
+	m_stateCv.notify_all();
+}
+
+void HackRFTransmitter::_workerThread()
+{
+	if (!m_device->StartTx()) //Fail and return if we cannot start TX
 	{
 		m_TX_On = false;
 		m_started.set_value(false);
+		_notifyState();
 		return;
 	}
 	else
 		m_started.set_value(true);	//Release waiter in StartTX() method
 
-	//Stop if no data for TX (when m_noIdleTx). We start at least to test that we are able to start
-	if (m_noIdleTx && m_currentChunk.empty() && m_waveQueue.empty())
-		m_device.StopTx();
-
 	while (!m_stop) //Continue untill we tell to stop
 	{
-		std::lock_guard<std::mutex> lock(m_queueMutex);
-		if (!m_currentChunk.empty()) //If we still have unfinished subchunk - finish it first
+		//Any push, stop or consumed tx buf after this point wakes the wait below
+		uint32_t events = m_events.load(std::memory_order_acquire);
+
+		//Subchunk is modulated right into free tx bufs, so wait until device callback frees them
+		if (m_ring.FreeSlots() < SUBCHUNK_BUFS)
 		{
-			processSubChunk();
+			m_events.wait(events, std::memory_order_acquire);
 			continue;
 		}
-		
-		if (m_waveQueue.empty()) //When queue is empty and no chunks for TX
-			m_emptyQueue = true;
-		else
+
+		//Subchunk boundary: critical chunk, cancel or clear may take over current chunk
+		if (m_preempt.exchange(false, std::memory_order_acq_rel))
+			_preempt();
+
+		auto prepared = _prepareNext();
+		if (prepared == PrepareResult::Subchunk)
+		{
+			if (!m_device->IsRunning()) // Start TX if it is down.
+				m_device->StartTx();
+
+			_nextSubChunk(); // Transmit prepared subchunk.
+			continue;
+		}
+
+		//Device callback wakes worker with every tx buf it takes, rate is changed when the last one is gone
+		if (prepared == PrepareResult::Drain)
+		{
+			m_events.wait(events, std::memory_order_acquire);
+			continue;
+		}
+
+		//Current chunk is over, take the next one from queue
+		m_currentChunk.Clear();
+		if (_popChunk())
+			continue;
+
+		if (m_ring.Empty())
 		{
-			//If we finished last chunk - pop out next from queue
-			if (m_subchunkOffset >= m_currentChunk.size())
-			{
-				m_currentChunk = std::move(m_waveQueue.front()); //Should be faster
-				m_waveQueue.pop();
-
-				//Reset FM phase and subchunk offset before transmitting new subchunk of our new chunk
-				m_subchunkOffset = 0;
-				m_FM_phase = 0;
-				if (!_prepareNext()) //Prepare first subchunk to be transmitted
-				{
-					m_currentChunk.clear();
-					continue;
-				}
-			}
-
-			processSubChunk();
+			// Stop TX if No-TX when idle feature is enabled, the queue is empty and everything is sent.
+			if (m_noIdleTx && m_device->IsRunning())
+				m_device->StopTx();
+
+			if (m_config.releaseWhenIdle)
+				_releaseBuffers();
+
+			_notifyState();
 		}
+
+		m_events.wait(events, std::memory_order_acquire);
 	}
 
 	m_TX_On = false;
-	m_stopped.set_value(!m_device.StopTx());
+	m_stopped.set_value(m_device->StopTx());
+	_notifyState();
 }
 
 bool HackRFTransmitter::StopTX()
@@ -234,6 +450,7 @@ bool HackRFTransmitter::StopTX()
 		return false;
 
 	m_stop = true;
+	_signal();
 	auto fut = m_stopped.get_future();
 	if (fut.wait_for(30s) != std::future_status::ready)
 		throw std::runtime_error("Failed to stop TX. Timeout.");
@@ -243,6 +460,7 @@ bool HackRFTransmitter::StopTX()
 	delete m_queueThread;
 	m_queueThread = nullptr;
 	m_hackrf_sample = 0;
+	m_resampleRatio = 0;
 
 	return stopped;
 }
@@ -268,6 +486,22 @@ uint32_t HackRFTransmitter::GetDeviceSampleRate() const
 	return m_hackrf_sample;
 }
 
+double HackRFTransmitter::GetResampleRatio() const
+{
+	return m_resampleRatio;
+}
+
+void HackRFTransmitter::SetFixedDeviceSampleRate(uint32_t sampleRate)
+{
+	if (m_TX_On)
+		throw std::runtime_error("Trying to change device sample rate while TX is active.");
+
+	if (sampleRate != 0 && (sampleRate < MIN_SAMPLE_RATE || sampleRate > MAX_SAMPLE_RATE))
+		throw std::runtime_error("Device sample rate must be in range of 2-20 MHz.");
+
+	m_fixedSampleRate = sampleRate;
+}
+
 void HackRFTransmitter::SetPCMSamplingRate(size_t sampleRate)
 {
 	if (m_TX_On)
@@ -276,175 +510,393 @@ void HackRFTransmitter::SetPCMSamplingRate(size_t sampleRate)
 	m_pcmSampleRate = (uint32_t)sampleRate;
 }
 
-void HackRFTransmitter::PushSamples(const HackRF_PCMSource& samples)
+HackRFTransmitter::ChunkHandle HackRFTransmitter::PushSamples(const HackRF_PCMSource& samples, Priority priority)
 {
-	std::lock_guard<std::mutex> lock(m_queueMutex);
+	Chunk_t chunk;
+	chunk.pcm = samples.GetSharedBuf();
+	chunk.sampleRate = samples.GetSamplingRate();
+	return _pushPCM(std::move(chunk), priority);
+}
+
+HackRFTransmitter::ChunkHandle HackRFTransmitter::PushSamples(HackRF_PCMSource&& samples, Priority priority)
+{
+	HackRF_PCMSource source(std::move(samples));
+	return PushSamples(source, priority);
+}
+
+HackRFTransmitter::ChunkHandle HackRFTransmitter::PushSamples(std::shared_ptr<IHackRFStream> stream, Priority priority)
+{
+	if (!stream || stream->GetSamplingRate() == 0)
+		throw std::runtime_error("Invalid stream.");
+
+	Chunk_t chunk;
+	chunk.type = ChunkType::Stream;
+	chunk.sampleRate = stream->GetSamplingRate();
+	chunk.stream = std::move(stream);
+	return _pushPCM(std::move(chunk), priority);
+}
 
+HackRFTransmitter::ChunkHandle HackRFTransmitter::_pushPCM(Chunk_t&& chunk, Priority priority)
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
 	if (!m_TX_On || m_TX_On && m_pcmSampleRate == 0)
-		m_pcmSampleRate = samples.GetSamplingRate();
-	
-	m_waveQueue.push(samples.GetRawBuf());
-	m_emptyQueue = false;
+		m_pcmSampleRate = chunk.sampleRate;
+
+	return _push(std::move(chunk), priority);
 }
 
-uint32_t HackRFTransmitter::GetChunkSizeSamples() const
+HackRFTransmitter::ChunkHandle HackRFTransmitter::PushSamples(const HackRF_FSKSource& bits, Priority priority)
 {
-	return m_subchunkSizeSamples;
+	Chunk_t chunk;
+	chunk.type = ChunkType::FSK;
+	chunk.bits = bits.GetBits();
+	chunk.bitCount = bits.GetBitCount();
+	chunk.bps = bits.GetBPS();
+	chunk.deviationHz = bits.GetDeviationHz();
+
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	return _push(std::move(chunk), priority);
 }
 
-void HackRFTransmitter::_interpolation() 
+//Called with m_queueMutex locked
+HackRFTransmitter::ChunkHandle HackRFTransmitter::_push(Chunk_t&& chunk, Priority priority)
 {
-	size_t i;		/* Input buffer index + 1. */
-	uint32_t j = 0;	/* Output buffer index. */
-	float pos;		/* Position relative to the input buffer
-					* + 1.0. */
+	if ((size_t)priority >= PRIORITY_LANES)
+		throw std::runtime_error("Invalid priority.");
+
+	chunk.handle = m_nextHandle++;
+	chunk.priority = priority;
+	chunk.queuedAt = std::chrono::steady_clock::now();
+	ChunkHandle handle = chunk.handle;
+
+	m_queuedBytes += _chunkBytes(chunk);
+	m_lanes[(size_t)priority].push_back(std::move(chunk));
+	m_laneCounters[(size_t)priority].pushed++;
+	m_emptyQueue = false;
 
-					/* We always "stay one sample behind", so what would be our first sample
-					* should be the last one wrote by the previous call. */
-	float* in_buf = &m_currentChunk[m_subchunkOffset];
-	pos = (float)m_sample_count / (float)BUF_LEN;
-	while (pos < 1.0)
+	if (priority == Priority::Critical && m_currentHandle != 0 && m_currentPriority != Priority::Critical)
+		m_preempt = true;
+
+	_signal();
+	return handle;
+}
+
+bool HackRFTransmitter::Cancel(ChunkHandle handle)
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	for (size_t lane = 0; lane < PRIORITY_LANES; lane++)
 	{
-		m_interpolatedBuf[j] = m_last_in_samples[3] + (in_buf[0] - m_last_in_samples[3]) * pos;
-		j++;
-		pos = (float)(j + 1) * (float)m_sample_count / (float)BUF_LEN;
+		auto& queue = m_lanes[lane];
+		for (auto it = queue.begin(); it != queue.end(); ++it)
+		{
+			if (it->handle != handle)
+				continue;
+
+			m_queuedBytes -= _chunkBytes(*it);
+			queue.erase(it);
+			m_laneCounters[lane].cancelled++;
+			_signal(); //Worker updates idle state if queue became empty
+			return true;
+		}
 	}
 
-	/* Interpolation cycle. */
-	i = (uint32_t)pos;
-	while (j < (BUF_LEN - 1))
-	{
+	if (handle == 0 || handle != m_currentHandle)
+		return false;
 
-		m_interpolatedBuf[j] = in_buf[i - 1] + (in_buf[i] - in_buf[i - 1]) * (pos - (float)i);
-		j++;
-		pos = (float)(j + 1) * (float)m_sample_count / (float)BUF_LEN;
-		i = (uint32_t)pos;
+	m_laneCounters[(size_t)m_currentPriority].cancelled++;
+	if (m_TX_On)
+	{
+		m_abortCurrent = true;
+		m_preempt = true;
+		_signal();
 	}
+	else
+	{
+		m_currentChunk.Clear();
+		m_currentHandle = 0;
+		m_resampler.Reset();
+	}
+	return true;
+}
 
-	/* The last sample is always the same in input and output buffers. */
-	m_interpolatedBuf[j] = in_buf[m_sample_count - 1];
+void HackRFTransmitter::Clear(Priority lane)
+{
+	if ((size_t)lane >= PRIORITY_LANES)
+		throw std::runtime_error("Invalid priority.");
 
-	/* Copy last samples to m_last_in_samples (reusing i and j). */
-	for (i = m_sample_count - 4, j = 0; j < 4; i++, j++)
-		m_last_in_samples[j] = in_buf[i];
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	auto& queue = m_lanes[(size_t)lane];
+	for (const auto& chunk : queue)
+		m_queuedBytes -= _chunkBytes(chunk);
+	m_laneCounters[(size_t)lane].cancelled += queue.size();
+	queue.clear();
+	_signal();
 }
 
-void HackRFTransmitter::_modulation() 
+HackRFTransmitter::LaneStats HackRFTransmitter::GetLaneStats(Priority lane) const
+{
+	if ((size_t)lane >= PRIORITY_LANES)
+		throw std::runtime_error("Invalid priority.");
+
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	const auto& queue = m_lanes[(size_t)lane];
+	const auto& counters = m_laneCounters[(size_t)lane];
+
+	LaneStats stats;
+	stats.depth = queue.size();
+	for (const auto& chunk : queue)
+		stats.queuedSeconds += chunk.Seconds();
+	if (!queue.empty())
+		stats.oldestWaitSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - queue.front().queuedAt).count();
+
+	stats.lastWaitSec = counters.lastWaitSec;
+	stats.maxWaitSec = counters.maxWaitSec;
+	stats.avgWaitSec = counters.started ? counters.totalWaitSec / counters.started : 0;
+	stats.pushed = counters.pushed;
+	stats.started = counters.started;
+	stats.preempted = counters.preempted;
+	stats.cancelled = counters.cancelled;
+	return stats;
+}
+
+size_t HackRFTransmitter::_chunkBytes(const Chunk_t& chunk)
+{
+	return (chunk.pcm ? chunk.pcm->capacity() * sizeof(float) : 0) + chunk.bits.capacity()
+		+ (chunk.resume ? chunk.resume->buf.capacity() * sizeof(float) : 0);
+}
+
+size_t HackRFTransmitter::GetMemoryFootprint() const
 {
-	double fm_deviation = 2.0 * M_PI * m_FMdeviationKHz / m_hackrf_sample;
+	return m_ring.GetAllocatedBytes() + m_dspBytes + m_queuedBytes;
+}
+
+uint32_t HackRFTransmitter::GetChunkSizeSamples() const
+{
+	return m_subchunkSizeSamples;
+}
 
-	//AM mode
-	//Works so poor and unstable, needs to be re-implemented
-	if (m_AM) 
+void HackRFTransmitter::_resample()
+{
+	//Fills whole subchunk at device rate. Input consumed per subchunk depends on ratio of chunk.
+	static const std::vector<float> none;
+	const auto& pcm = m_currentChunk.pcm ? *m_currentChunk.pcm : none;
+	size_t produced = 0;
+	while (produced < m_bufLen && m_subchunkOffset < pcm.size())
 	{
-		for (uint32_t i = 0; i < BUF_LEN; i++) 
-		{
-			double	audio_amp = m_interpolatedBuf[i] * m_localGain;
+		size_t written = 0;
+		m_subchunkOffset += m_resampler.Process(&pcm[m_subchunkOffset], pcm.size() - m_subchunkOffset, &m_interpolatedBuf[produced], m_bufLen - produced, written);
+		produced += written;
+	}
 
-			if (fabs(audio_amp) > 1.0)
-				audio_amp = (audio_amp > 0.0) ? 1.0 : -1.0;
+	//Filter tail after the last sample of chunk, then silence (unmodulated carrier)
+	while (produced < m_bufLen && m_subchunkOffset >= pcm.size())
+	{
+		size_t written = m_resampler.Flush(&m_interpolatedBuf[produced], m_bufLen - produced);
+		if (written == 0)
+			break;
+		produced += written;
+	}
 
-			m_IQ_buf[i * BYTES_PER_SAMPLE] = float(audio_amp);
-			m_IQ_buf[i * BYTES_PER_SAMPLE + 1] = 0;
+	std::fill(m_interpolatedBuf.begin() + produced, m_interpolatedBuf.end(), 0.0f);
+}
+
+void HackRFTransmitter::_resampleStream()
+{
+	//Scratch is refilled only when it is consumed, so stream is read at most one subchunk ahead
+	auto& stream = *m_currentChunk.stream;
+	size_t produced = 0;
+	while (produced < m_bufLen)
+	{
+		if (m_streamPos == m_streamLen)
+		{
+			m_streamPos = 0;
+			m_streamLen = stream.Read(m_streamBuf.data(), m_streamBuf.size());
+			if (m_streamLen == 0)
+				break;
 		}
+
+		size_t written = 0;
+		m_streamPos += m_resampler.Process(&m_streamBuf[m_streamPos], m_streamLen - m_streamPos, &m_interpolatedBuf[produced], m_bufLen - produced, written);
+		produced += written;
 	}
-	//FM mode
-	//Also is FSK mode too! Just try to send something like POCSAG samples in PCM format
-	else 
+
+	//Filter tail after the end of stream. Underrun of live stream is sent as silence.
+	while (produced < m_bufLen && stream.IsFinished())
 	{
-		for (uint32_t i = 0; i < BUF_LEN; i++) 
-		{
-			double audio_amp = m_interpolatedBuf[i] * m_localGain;
+		size_t written = m_resampler.Flush(&m_interpolatedBuf[produced], m_bufLen - produced);
+		if (written == 0)
+			break;
+		produced += written;
+	}
 
-			if (fabs(audio_amp) > 1.0)
-				audio_amp = (audio_amp > 0.0) ? 1.0 : -1.0;
+	std::fill(m_interpolatedBuf.begin() + produced, m_interpolatedBuf.end(), 0.0f);
+}
 
-			m_FM_phase += fm_deviation * audio_amp;
-			while (m_FM_phase > (float)(M_PI))
-				m_FM_phase -= (float)(2.0 * M_PI);
-			while (m_FM_phase < (float)(-M_PI))
-				m_FM_phase += (float)(2.0 * M_PI);
+int8_t* HackRFTransmitter::_slotIQ(uint32_t sample)
+{
+	//Subchunk is modulated straight into the free tx bufs of ring
+	const uint32_t slotSamples = m_bufLen / BYTES_PER_SAMPLE;
+	return m_ring.WriteSlot(sample / slotSamples) + (sample % slotSamples) * BYTES_PER_SAMPLE;
+}
 
-			m_IQ_buf[i * BYTES_PER_SAMPLE] = (float)sin(m_FM_phase);
-			m_IQ_buf[i * BYTES_PER_SAMPLE + 1] = (float)cos(m_FM_phase);
-		}
+void HackRFTransmitter::_modulation() 
+{
+	const uint32_t slotSamples = m_bufLen / BYTES_PER_SAMPLE;
+	uint32_t* dither = m_dither ? &m_ditherState : nullptr;
+	float deviationScale = HackRF_Modulator::DeviationScale(m_FMdeviationKHz, m_hackrf_sample);
+
+	for (uint32_t i = 0; i < m_bufLen; i += slotSamples)
+	{
+		//AM mode
+		//Works so poor and unstable, needs to be re-implemented
+		if (m_AM)
+			HackRF_Modulator::AM(&m_interpolatedBuf[i], slotSamples, m_localGain, _slotIQ(i), dither);
+		//FM mode
+		//Also is FSK mode too! Just try to send something like POCSAG samples in PCM format
+		else
+			HackRF_Modulator::FM(&m_interpolatedBuf[i], slotSamples, m_localGain, deviationScale, m_FM_phase, _slotIQ(i), dither);
 	}
 }
 
-void HackRFTransmitter::_work(size_t offset) 
+void HackRFTransmitter::_tone(uint32_t first, uint32_t count, int32_t increment)
 {
-	std::lock_guard<std::mutex> lock(m_deviceMutex);
-	auto& buf = m_workerBuf[m_head];
-	for (uint32_t i = 0; i < BUF_LEN; i++) 
-		buf[i] = (int8_t)(m_IQ_buf[i + offset] * 127.0);
-	m_head = (m_head + 1) % BUF_NUM;
-	m_leftToSend++;
+	const uint32_t slotSamples = m_bufLen / BYTES_PER_SAMPLE;
+	uint32_t* dither = m_dither ? &m_ditherState : nullptr;
+	while (count > 0)
+	{
+		uint32_t n = slotSamples - first % slotSamples;
+		if (n > count)
+			n = count;
+
+		HackRF_Modulator::Tone(n, increment, m_FM_phase, _slotIQ(first), dither);
+		first += n;
+		count -= n;
+	}
 }
 
-int HackRFTransmitter::onData(int8_t* buffer, uint32_t length)
+void HackRFTransmitter::_synthesizeFSK()
 {
-	std::lock_guard<std::mutex> lock(m_deviceMutex);
+	//Phase continuous 2-FSK: each sample advances phase by one of two increments depending on current bit
+	const double samplesPerBit = double(m_hackrf_sample) / m_currentChunk.bps;
+	const int32_t step = HackRF_Modulator::PhaseIncrement(m_currentChunk.deviationHz, m_hackrf_sample);
+	const auto& bits = m_currentChunk.bits;
+	uint32_t i = 0;
 
-	if (m_leftToSend == 0)
-		memset(buffer, 0, length);
-	else 
+	while (i < m_bufLen && m_subchunkOffset < m_currentChunk.bitCount)
 	{
-		int8_t* p = &(m_workerBuf[m_tail][0]);
-		memcpy(buffer, p, length);
-		m_tail = (m_tail + 1) % BUF_NUM;
-		m_leftToSend--;
-		if (m_leftToSend == 0)
-			m_ready = true;
+		if (m_fskSamplesLeft < 1.0)
+			m_fskSamplesLeft += samplesPerBit;
+
+		size_t bit = m_subchunkOffset;
+		int32_t increment = (bits[bit / 8] & (0x80 >> (bit % 8))) ? step : -step;
+		uint32_t run = uint32_t(m_fskSamplesLeft);
+		if (run > m_bufLen - i)
+			run = m_bufLen - i;
+
+		_tone(i, run, increment);
+		i += run;
+
+		m_fskSamplesLeft -= run;
+		if (m_fskSamplesLeft < 1.0)
+			m_subchunkOffset++;
 	}
 
-	return 0;
+	//Unmodulated carrier after the last bit
+	_tone(i, m_bufLen - i, 0);
 }
 
-bool HackRFTransmitter::_prepareNext()
+int HackRFTransmitter::onData(int8_t* buffer, uint32_t length)
 {
-	auto samples = m_currentChunk.size();
-	if (m_subchunkOffset >= samples)
-		return false;
+	//Never blocks: takes the next published tx buf or sends silence if worker is behind.
+	//Wakes worker only when tx buf was freed, so idle worker sleeps.
+	if (m_ring.Pop(buffer, length))
+		_signal();
 
-	if (m_subchunkOffset + m_subchunkSizeSamples > samples)
-		m_sample_count = samples - m_subchunkOffset;
+	return 0;
+}
+
+HackRFTransmitter::PrepareResult HackRFTransmitter::_prepareNext()
+{
+	if (m_currentChunk.type == ChunkType::Stream)
+	{
+		if (m_streamPos == m_streamLen && m_currentChunk.stream->IsFinished() && m_resampler.Drained())
+			return PrepareResult::End;
+	}
 	else
-		m_sample_count = m_subchunkSizeSamples;
+	{
+		auto samples = m_currentChunk.Size();
+		if (m_subchunkOffset >= samples && (m_currentChunk.type == ChunkType::FSK || m_resampler.Drained()))
+			return PrepareResult::End;
+	}
 
+	if (m_currentChunk.type == ChunkType::FSK)
+	{
+		//Bits are synthesized at any device rate, so keep current one to avoid reconfiguration.
+		//Rate set here stays until queued bufs of page are sent, PCM chunk after it drains ring before changing it.
+		if (m_hackrf_sample == 0 && !_changeSampleRate(FSK_SAMPLE_RATE))
+			return PrepareResult::Drain;
+
+		m_resampleRatio = 0;
+		_synthesizeFSK();
+		return PrepareResult::Subchunk;
+	}
 
-	uint32_t newRFSampleRate = 0;
+	if (m_interpolatedBuf.size() != m_bufLen)
 	{
-		std::lock_guard<std::mutex> lock(m_queueMutex);
-		newRFSampleRate = uint32_t((m_pcmSampleRate * 1.0 / m_subchunkSizeSamples) * BUF_LEN);
+		m_interpolatedBuf.resize(m_bufLen);
+		m_dspBytes = (m_interpolatedBuf.capacity() + m_streamBuf.capacity()) * sizeof(float);
 	}
-	
-	if (m_hackrf_sample != newRFSampleRate)
+
+	//Legacy mode: device rate follows rate of current chunk, which can differ between chunks (bitrates of minimum
+	//sample rate encoding). Fixed mode never touches it.
+	if (m_fixedSampleRate == 0)
 	{
-		m_hackrf_sample = newRFSampleRate;
-		m_device.SetSampleRate(m_hackrf_sample);
+		if (!_changeSampleRate(_legacySampleRate(m_currentChunk.sampleRate)))
+			return PrepareResult::Drain;
 	}
 
-	_interpolation();
+	m_resampleRatio = m_resampler.GetRatio();
+	if (m_currentChunk.type == ChunkType::Stream)
+	{
+		//Scratch holds input of one subchunk, ratio is constant during chunk
+		size_t scratch = std::clamp(size_t(m_bufLen / m_resampleRatio) + 1, STREAM_MIN_READ, size_t(m_bufLen));
+		if (m_streamBuf.size() != scratch && m_streamPos == m_streamLen)
+		{
+			m_streamBuf.resize(scratch);
+			m_streamPos = 0;
+			m_streamLen = 0;
+			m_dspBytes = (m_interpolatedBuf.capacity() + m_streamBuf.capacity()) * sizeof(float);
+		}
+		_resampleStream();
+	}
+	else
+		_resample();
 	_modulation();
+	return PrepareResult::Subchunk;
+}
+
+//Tx bufs in ring are modulated for current device rate, at the new one they would be clocked out with wrong duration,
+//pitch and deviation. So rate changes only when device has taken all of them, until then it returns false.
+bool HackRFTransmitter::_changeSampleRate(uint32_t sampleRate)
+{
+	if (m_hackrf_sample == sampleRate)
+		return true;
+	if (!m_ring.Empty())
+		return false;
 
-	m_subchunkOffset += m_sample_count;
+	m_hackrf_sample = sampleRate;
+	m_device->SetSampleRate(m_hackrf_sample);
 	return true;
 }
 
 void HackRFTransmitter::_nextSubChunk()
 {
-	auto samples = m_currentChunk.size();
-	if (m_subchunkOffset >= samples)
-		return;
-
-	m_ready = false;
-	for (uint32_t i = 0; i < (BUF_LEN * BYTES_PER_SAMPLE); i += BUF_LEN)
-		_work(i);
+	m_ring.Publish(SUBCHUNK_BUFS);
 }
 
 bool HackRFTransmitter::IsIdle() const
 {
-	return m_currentChunk.empty() && m_emptyQueue && m_TX_On;
+	return m_emptyQueue && m_ring.Empty() && m_TX_On;
 }
 
 bool HackRFTransmitter::IsRunning() const
@@ -454,32 +906,12 @@ bool HackRFTransmitter::IsRunning() const
 
 bool HackRFTransmitter::WaitForEnd(const std::chrono::milliseconds timeout) const
 {
-	std::chrono::milliseconds waiting = 0ms;
-
-	while (waiting < timeout)
-	{
-		if (!m_TX_On)
-			return true;
-
-		std::this_thread::sleep_for(10ms);
-		waiting += 10ms;
-	}
-
-	return false;
+	std::unique_lock<std::mutex> lock(m_stateMutex);
+	return m_stateCv.wait_for(lock, timeout, [this]() { return !m_TX_On; });
 }
 
 bool HackRFTransmitter::WaitForIdle(const std::chrono::milliseconds timeout) const
 {
-	std::chrono::milliseconds waiting = 0ms;
-
-	while (waiting < timeout)
-	{
-		if (IsIdle())
-			return true;
-
-		std::this_thread::sleep_for(10ms);
-		waiting += 10ms;
-	}
-
-	return false;
+	std::unique_lock<std::mutex> lock(m_stateMutex);
+	return m_stateCv.wait_for(lock, timeout, [this]() { return IsIdle(); });
 }
\ No newline at end of file
@@ -12,55 +12,191 @@
 
 #include <mutex>
 #include "IHackRFData.h"
-#include "HackRFDevice.h"
+#include "IHackRFDevice.h"
 #include "HackRF_PCMSource.h"
+#include "HackRF_FSKSource.h"
+#include "IHackRFStream.h"
+#include "HackRF_Modulator.h"
+#include "HackRF_TxRing.h"
+#include "HackRF_Resampler.h"
 #include <atomic>
 #include <thread>
-#include <queue>
+#include <deque>
 #include <future>
+#include <memory>
+#include <condition_variable>
 
 class HackRFTransmitter : public IHackRFData
 {
+public:
+	//Memory budget of transmitter. Tx bufs are allocated on first use and released when idle.
+	struct Config
+	{
+		size_t ringSlots = 16;			//Count of tx bufs in ring. More bufs is more tolerance to worker delays, but more latency.
+		size_t transferSize = 262144;	//Size of tx buf in bytes, must be even. Each subchunk is transferSize I/Q pairs (2 tx bufs).
+		bool releaseWhenIdle = true;	//Free tx bufs and DSP buffers every time queue is empty and everything is sent
+	};
+
+	//Queue lanes. Chunks are taken from the highest non-empty lane, FIFO inside of lane.
+	//Critical chunk preempts chunk of any other lane at the next subchunk boundary.
+	enum class Priority
+	{
+		Critical,
+		High,
+		Normal,
+		Low
+	};
+
+	static constexpr size_t PRIORITY_LANES = 4;
+
+	//Identifies pushed chunk for Cancel(). 0 is never returned.
+	using ChunkHandle = uint64_t;
+
+	struct LaneStats
+	{
+		size_t depth = 0;				//Queued chunks
+		double queuedSeconds = 0;		//Air time of queued chunks
+		double oldestWaitSec = 0;		//How long the first queued chunk is waiting
+		double lastWaitSec = 0;			//Wait time of the last started chunk, from push to start of transmission
+		double maxWaitSec = 0;
+		double avgWaitSec = 0;
+		uint64_t pushed = 0;
+		uint64_t started = 0;			//Restarts after preemption are not counted
+		uint64_t preempted = 0;
+		uint64_t cancelled = 0;			//Including chunks removed by Clear()
+	};
+
 private:
-	using WorkerBuf_t = std::vector<std::vector<int8_t>>;
-	using PCMChunk_t = std::vector<float>;
-	using PCMQueue_t = std::queue<PCMChunk_t>;
-
-	HackRFDevice m_device;
-	std::mutex m_deviceMutex;
-	std::mutex m_queueMutex;
-	int m_leftToSend;
-	WorkerBuf_t m_workerBuf;
-	int m_tail;
-	int m_head;
+	using PCMChunk_t = HackRF_ChunkPool::Shared_t; //Shared with HackRF_PCMSource, never copied
+
+	enum class PrepareResult
+	{
+		Subchunk,	//Subchunk is modulated into tx bufs and can be published
+		Drain,		//Device rate must change, queued tx bufs of the old rate have to be sent first
+		End			//Current chunk is over
+	};
+
+	enum class ChunkType
+	{
+		PCM,	//Float samples at sample rate of chunk, interpolated and modulated
+		FSK,	//Packed bits, I/Q is synthesized directly at device sample rate
+		Stream	//Same as PCM, but samples are read from stream subchunk by subchunk
+	};
+
+	//Input of preempted stream which was read but not transmitted yet, and filter state to continue it without a seam
+	struct StreamResume_t
+	{
+		std::vector<float> buf;
+		size_t pos = 0;
+		size_t len = 0;
+		HackRF_Resampler resampler;
+	};
+
+	struct Chunk_t
+	{
+		ChunkHandle handle = 0;
+		Priority priority = Priority::Normal;
+		std::chrono::steady_clock::time_point queuedAt;
+		bool started = false;	//Was transmitted before preemption
+		ChunkType type = ChunkType::PCM;
+		PCMChunk_t pcm;
+		std::shared_ptr<IHackRFStream> stream;
+		std::shared_ptr<StreamResume_t> resume;	//Set when stream is preempted
+		uint32_t sampleRate = 0;
+		std::vector<uint8_t> bits; //MSB first
+		size_t bitCount = 0;
+		uint16_t bps = 0;
+		double deviationHz = 0;
+
+		size_t Samples() const { return pcm ? pcm->size() : 0; }
+		size_t Size() const { return type == ChunkType::PCM ? Samples() : bitCount; }
+		double Seconds() const
+		{
+			if (type == ChunkType::FSK)
+				return double(bitCount) / bps;
+			size_t samples = type == ChunkType::Stream ? (size_t)stream->GetLengthSamples() : Samples();
+			return sampleRate ? double(samples) / sampleRate : 0;
+		}
+		bool Empty() const { return type == ChunkType::Stream ? !stream : Size() == 0; }
+		void Clear() { *this = Chunk_t(); }
+	};
+
+	using ChunkQueue_t = std::deque<Chunk_t>;
+
+	struct LaneCounters
+	{
+		double lastWaitSec = 0;
+		double maxWaitSec = 0;
+		double totalWaitSec = 0;
+		uint64_t pushed = 0;
+		uint64_t started = 0;
+		uint64_t preempted = 0;
+		uint64_t cancelled = 0;
+	};
+
+	Config m_config;
+	std::unique_ptr<IHackRFDevice> m_device;
+	mutable std::mutex m_queueMutex;
+	HackRF_TxRing m_ring;
+	uint32_t m_bufLen;
+	std::atomic<size_t> m_dspBytes;
+	std::atomic<size_t> m_queuedBytes;
 	float m_localGain;
 	std::vector<float> m_interpolatedBuf;
-	std::vector<float> m_IQ_buf;
+	std::vector<float> m_streamBuf;	//Input of about one subchunk read from stream
+	size_t m_streamPos;
+	size_t m_streamLen;
 	uint32_t m_sample_rate;
-	size_t m_sample_count;
 	uint32_t m_hackrf_sample;
-	float m_last_in_samples[4];
+	uint32_t m_fixedSampleRate;	//Device runs at this rate during whole TX if not 0, PCM is resampled to it
+	HackRF_Resampler m_resampler;
+	std::atomic<double> m_resampleRatio;
 	uint32_t m_subchunkSizeSamples;
-	PCMQueue_t m_waveQueue;
-	PCMChunk_t m_currentChunk;
+	ChunkQueue_t m_lanes[PRIORITY_LANES];
+	LaneCounters m_laneCounters[PRIORITY_LANES];
+	ChunkHandle m_nextHandle;
+	ChunkHandle m_currentHandle;	//Chunk which worker transmits, guarded by m_queueMutex
+	Priority m_currentPriority;
+	std::atomic<bool> m_preempt;	//Worker must look at queue before the next subchunk
+	bool m_abortCurrent;			//Drop current chunk at the next subchunk boundary, guarded by m_queueMutex
+	Chunk_t m_currentChunk;
 	uint32_t m_pcmSampleRate;
-	size_t m_subchunkOffset;
+	size_t m_subchunkOffset;	//Samples for PCM chunk, bits for FSK chunk
+	double m_fskSamplesLeft;	//Samples left until the end of current FSK bit
 	double m_FMdeviationKHz;
 	bool m_AM;
 	bool m_noIdleTx;
-	std::atomic<bool> m_ready;
-	double m_FM_phase;
+	bool m_dither;
+	uint32_t m_ditherState;
+	HackRF_Modulator::Phase_t m_FM_phase;
 	std::thread* m_queueThread;
 	std::promise<bool> m_stopped;
 	std::promise<bool> m_started;
 	std::atomic<bool> m_stop;
 	std::atomic<bool> m_emptyQueue;
 	std::atomic<bool> m_TX_On;
+	std::atomic<uint32_t> m_events;			//Bumped on every event worker may wait for, futex style
+	mutable std::mutex m_stateMutex;
+	mutable std::condition_variable m_stateCv;	//Notified by worker on idle and on end of TX
 
-	void _interpolation();
+	void _resample();
+	void _resampleStream();
 	void _modulation();
-	void _work(size_t offset);
-	bool _prepareNext();
+	void _synthesizeFSK();
+	int8_t* _slotIQ(uint32_t sample);
+	void _tone(uint32_t first, uint32_t count, int32_t increment);
+	PrepareResult _prepareNext();
+	bool _changeSampleRate(uint32_t sampleRate);
+	bool _popChunk();
+	void _preempt();
+	ChunkHandle _push(Chunk_t&& chunk, Priority priority);
+	ChunkHandle _pushPCM(Chunk_t&& chunk, Priority priority);
+	uint32_t _legacySampleRate(uint32_t pcmSampleRate) const;
+	bool _lanesEmpty() const;
+	void _releaseBuffers();
+	void _signal();
+	void _notifyState();
+	static size_t _chunkBytes(const Chunk_t& chunk);
 	void _workerThread();
 	void _nextSubChunk();
 
@@ -69,17 +205,32 @@ protected:
 
 public:
 	HackRFTransmitter(float localGain = 90.0f);
+	explicit HackRFTransmitter(const Config& config, float localGain = 90.0f);
+	//Any backend, e.g. HackRF_NullDevice to run without radio. Default constructors use HackRFDevice.
+	explicit HackRFTransmitter(std::unique_ptr<IHackRFDevice> device, float localGain = 90.0f);
+	HackRFTransmitter(std::unique_ptr<IHackRFDevice> device, const Config& config, float localGain = 90.0f);
 	~HackRFTransmitter();
 
 	//Safe to call while TX is active
-	void PushSamples(const HackRF_PCMSource& samples);
+	//PCM samples are shared with source, not copied. Moved source leaves the queue as the only owner.
+	ChunkHandle PushSamples(const HackRF_PCMSource& samples, Priority priority = Priority::Normal);
+	ChunkHandle PushSamples(HackRF_PCMSource&& samples, Priority priority = Priority::Normal);
+	ChunkHandle PushSamples(const HackRF_FSKSource& bits, Priority priority = Priority::Normal);
+	//Stream is read while it is transmitted. Preempted stream is not restarted, it continues after critical chunk.
+	ChunkHandle PushSamples(std::shared_ptr<IHackRFStream> stream, Priority priority = Priority::Normal);
+	bool Cancel(ChunkHandle handle); //Removes queued chunk or stops transmitting one at the next subchunk boundary. False if it's already sent.
+	void Clear(); //Clear all samples for TX. While TX is active chunk being transmitted is stopped at the next subchunk boundary.
+	void Clear(Priority lane); //Clear queued chunks of lane only
+	LaneStats GetLaneStats(Priority lane) const;
 
 	bool WaitForEnd(const std::chrono::milliseconds timeout) const;
 	bool WaitForIdle(const std::chrono::milliseconds timeout) const;
 	uint32_t GetDeviceSampleRate() const;
+	double GetResampleRatio() const; //Device samples per PCM sample of chunk being transmitted, 0 for FSK chunk or when nothing is transmitted
 	uint32_t GetChunkSizeSamples() const;
 	bool IsIdle() const;
 	bool IsRunning() const;
+	size_t GetMemoryFootprint() const; //Bytes of allocated tx bufs, DSP buffers and queued chunks
 	
 	//Excepts on call attempt while TX is active
 	void SetFrequency(uint64_t mhz, uint64_t khz, uint64_t hz = 0);
@@ -89,10 +240,11 @@ public:
 	void SetLocalGain(float gain);
 	void SetAMP(bool enableamp);
 	void SetPCMSamplingRate(size_t sampleRate);
+	void SetFixedDeviceSampleRate(uint32_t sampleRate); //0 to follow PCM sample rate (legacy mode). Otherwise 2-20 MHz.
 	void SetAM(bool set);
 	void SetFMDeviationKHz(double value);
 	void SetTurnOffTXWhenIdle(bool off);
-	void Clear(); //Clear all samples for TX
+	void SetDither(bool enable); //Adds triangular dither before quantization to int8
 
 	//Stop and start TX
 	bool StartTX(); //If cleanUpPrevData - cleans all chunks and subchunks
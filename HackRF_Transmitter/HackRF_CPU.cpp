@@ -0,0 +1,53 @@
+/*
+*  Subject: HackRF_CPU
+*  Purpose: Runtime detection of CPU features for SIMD kernels.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "HackRF_CPU.h"
+
+#if defined(HACKRF_X86) && defined(_MSC_VER)
+#include <intrin.h>
+
+static bool detectAVX2()
+{
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+
+	__cpuid(regs, 1);
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool fma = (regs[2] & (1 << 12)) != 0;
+	if (!osxsave || !fma)
+		return false;
+
+	//OS must save YMM registers
+	if ((_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+}
+#elif defined(HACKRF_X86)
+static bool detectAVX2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#else
+static bool detectAVX2()
+{
+	return false;
+}
+#endif
+
+bool HackRF_CPU::HasAVX2()
+{
+	static const bool avx2 = detectAVX2();
+	return avx2;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+*  Subject: HackRF_CPU
+*  Purpose: Runtime detection of CPU features for SIMD kernels.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HACKRF_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HACKRF_SSE2 1
+#endif
+
+//MSVC allows any intrinsics in any function, GCC and Clang need target attribute
+#if defined(HACKRF_X86) && !defined(_MSC_VER)
+#define HACKRF_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define HACKRF_TARGET_AVX2
+#endif
+
+class HackRF_CPU
+{
+public:
+	static bool HasAVX2();
+};
@@ -0,0 +1,110 @@
+/*
+*  Subject: HackRF_ChunkPool
+*  Purpose: Recycles sample storage of transmitted chunks for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "HackRF_ChunkPool.h"
+#include <map>
+#include <mutex>
+
+constexpr size_t DEFAULT_LIMIT_BYTES	= 64 * 1024 * 1024;
+constexpr size_t MAX_WASTE_FACTOR		= 2;	//Recycled buffer can be at most this times larger than requested
+
+//Deleters keep weak reference, so buffers released after the pool is destroyed at exit are simply freed
+struct PoolState
+{
+	std::mutex mutex;
+	std::multimap<size_t, HackRF_ChunkPool::Buffer_t> free; //By capacity
+	size_t bytes = 0;
+	size_t limit = DEFAULT_LIMIT_BYTES;
+};
+
+static const std::shared_ptr<PoolState>& poolState()
+{
+	static const std::shared_ptr<PoolState> state = std::make_shared<PoolState>();
+	return state;
+}
+
+static void recycle(const std::weak_ptr<PoolState>& weak, HackRF_ChunkPool::Buffer_t* buf)
+{
+	std::unique_ptr<HackRF_ChunkPool::Buffer_t> owner(buf);
+	auto state = weak.lock();
+	size_t bytes = buf->capacity() * sizeof(float);
+	if (!state || bytes == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(state->mutex);
+	if (state->bytes + bytes > state->limit)
+		return;
+
+	buf->clear();
+	state->bytes += bytes;
+	state->free.emplace(buf->capacity(), std::move(*buf));
+}
+
+HackRF_ChunkPool::Buffer_t HackRF_ChunkPool::Take(size_t minCapacity)
+{
+	Buffer_t result;
+	if (minCapacity == 0)
+		return result;
+
+	{
+		const auto& state = poolState();
+		std::lock_guard<std::mutex> lock(state->mutex);
+		auto it = state->free.lower_bound(minCapacity);
+		if (it != state->free.end() && it->first <= minCapacity * MAX_WASTE_FACTOR)
+		{
+			result = std::move(it->second);
+			state->bytes -= it->first * sizeof(float);
+			state->free.erase(it);
+			return result;
+		}
+	}
+
+	result.reserve(minCapacity);
+	return result;
+}
+
+HackRF_ChunkPool::Shared_t HackRF_ChunkPool::Share(Buffer_t&& samples)
+{
+	std::weak_ptr<PoolState> weak = poolState();
+	return Shared_t(new Buffer_t(std::move(samples)), [weak](const Buffer_t* buf) { recycle(weak, const_cast<Buffer_t*>(buf)); });
+}
+
+void HackRF_ChunkPool::SetLimit(size_t bytes)
+{
+	const auto& state = poolState();
+	std::lock_guard<std::mutex> lock(state->mutex);
+	state->limit = bytes;
+
+	//Drop the largest buffers first
+	while (state->bytes > state->limit)
+	{
+		auto it = std::prev(state->free.end());
+		state->bytes -= it->first * sizeof(float);
+		state->free.erase(it);
+	}
+}
+
+size_t HackRF_ChunkPool::GetPooledBytes()
+{
+	const auto& state = poolState();
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->bytes;
+}
+
+void HackRF_ChunkPool::Trim()
+{
+	std::multimap<size_t, Buffer_t> free;
+	{
+		const auto& state = poolState();
+		std::lock_guard<std::mutex> lock(state->mutex);
+		free.swap(state->free);
+		state->bytes = 0;
+	}
+}
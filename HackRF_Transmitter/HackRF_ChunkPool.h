@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+*  Subject: HackRF_ChunkPool
+*  Purpose: Recycles sample storage of transmitted chunks for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include <vector>
+#include <memory>
+#include <stddef.h>
+
+//Shared sample buffers are immutable, so the same chunk can be queued any number of times without copy.
+//When the last owner releases buffer, its storage goes back to pool instead of being freed.
+//Take() gives it to the next producer, e.g. as output vector of POCSAG::Encoder::encodeSamples().
+class HackRF_ChunkPool
+{
+public:
+	using Buffer_t = std::vector<float>;
+	using Shared_t = std::shared_ptr<const Buffer_t>;
+
+	//Empty vector with capacity of at least minCapacity. Recycled storage is used if there is one that fits.
+	static Buffer_t Take(size_t minCapacity);
+
+	//Takes ownership of samples. Storage is returned to pool when the last copy of pointer is gone.
+	static Shared_t Share(Buffer_t&& samples);
+
+	static void SetLimit(size_t bytes);	//Max bytes kept in pool, 64 MB by default. 0 disables recycling.
+	static size_t GetPooledBytes();
+	static void Trim();					//Free everything kept in pool
+};
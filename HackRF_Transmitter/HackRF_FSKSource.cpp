@@ -0,0 +1,74 @@
+/*
+*  Subject: HackRF_FSKSource
+*  Purpose: Packed bitstream with FSK parameters for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "HackRF_FSKSource.h"
+#include <stdexcept>
+#include <cstring>
+
+constexpr size_t POCSAG_PREAMBLE_SIZE_BYTES = 72;
+
+HackRF_FSKSource::HackRF_FSKSource(const std::vector<uint8_t>& rawPOCSAG, uint16_t bps, double deviationKHz)
+    : m_bitCount(rawPOCSAG.size() * 8)
+    , m_bps(bps)
+    , m_deviationHz(deviationKHz * 1000)
+{
+    if (rawPOCSAG.size() < POCSAG_PREAMBLE_SIZE_BYTES || (rawPOCSAG.size() - POCSAG_PREAMBLE_SIZE_BYTES) % 4 != 0)
+        throw std::runtime_error("This is not a raw POCSAG buffer.");
+
+    if (bps == 0)
+        throw std::runtime_error("Bitrate can't be zero.");
+
+    //Preamble is stored byte by byte, but codewords are stored as native 32bit integers. Send them MSB first.
+    m_bits.resize(rawPOCSAG.size());
+    memcpy(&m_bits[0], &rawPOCSAG[0], POCSAG_PREAMBLE_SIZE_BYTES);
+    for (size_t i = POCSAG_PREAMBLE_SIZE_BYTES; i < rawPOCSAG.size(); i += 4)
+    {
+        uint32_t cw;
+        memcpy(&cw, &rawPOCSAG[i], sizeof(cw));
+        m_bits[i] = uint8_t(cw >> 24);
+        m_bits[i + 1] = uint8_t(cw >> 16);
+        m_bits[i + 2] = uint8_t(cw >> 8);
+        m_bits[i + 3] = uint8_t(cw);
+    }
+}
+
+HackRF_FSKSource::HackRF_FSKSource(const uint8_t* bits, size_t bitCount, uint16_t bps, double deviationKHz)
+    : m_bits(bits, bits + (bitCount + 7) / 8)
+    , m_bitCount(bitCount)
+    , m_bps(bps)
+    , m_deviationHz(deviationKHz * 1000)
+{
+    if (bps == 0)
+        throw std::runtime_error("Bitrate can't be zero.");
+}
+
+HackRF_FSKSource::~HackRF_FSKSource()
+{
+}
+
+const std::vector<uint8_t>& HackRF_FSKSource::GetBits() const
+{
+    return m_bits;
+}
+
+size_t HackRF_FSKSource::GetBitCount() const
+{
+    return m_bitCount;
+}
+
+uint16_t HackRF_FSKSource::GetBPS() const
+{
+    return m_bps;
+}
+
+double HackRF_FSKSource::GetDeviationHz() const
+{
+    return m_deviationHz;
+}
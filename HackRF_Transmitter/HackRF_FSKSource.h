@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+*  Subject: HackRF_FSKSource
+*  Purpose: Packed bitstream with FSK parameters for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+//Push object of this class into transmitter queue to transmit 2-FSK data (like POCSAG) without PCM stage.
+//Transmitter synthesizes I/Q directly from bits at device sample rate, so only bits are stored in queue.
+class HackRF_FSKSource
+{
+private:
+	std::vector<uint8_t> m_bits; //MSB first
+	size_t m_bitCount;
+	uint16_t m_bps;
+	double m_deviationHz;
+
+	HackRF_FSKSource(const HackRF_FSKSource&) = delete;
+	HackRF_FSKSource& operator=(const HackRF_FSKSource&) = delete;
+
+public:
+	//Build bitstream from raw POCSAG buffer (POCSAG::Encoder::encode() with rawPOCSAG = true)
+	HackRF_FSKSource(const std::vector<uint8_t>& rawPOCSAG, uint16_t bps, double deviationKHz = 4.5);
+
+	//Build bitstream from packed bits. First bit is the most significant bit of the first byte.
+	HackRF_FSKSource(const uint8_t* bits, size_t bitCount, uint16_t bps, double deviationKHz);
+	~HackRF_FSKSource();
+
+	const std::vector<uint8_t>& GetBits() const;
+	size_t GetBitCount() const;
+	uint16_t GetBPS() const;
+	double GetDeviationHz() const;
+};
@@ -0,0 +1,212 @@
+/*
+*  Subject: HackRF_Modulator
+*  Purpose: Numerically controlled oscillator and FM modulator kernels for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "HackRF_Modulator.h"
+#include "HackRF_CPU.h"
+#include <cmath>
+
+constexpr uint32_t SIN_TABLE_BITS	= 12;
+constexpr uint32_t SIN_TABLE_SIZE	= 1 << SIN_TABLE_BITS;
+constexpr uint32_t SIN_TABLE_MASK	= SIN_TABLE_SIZE - 1;
+constexpr uint32_t SIN_TABLE_SHIFT	= 32 - SIN_TABLE_BITS;
+constexpr uint32_t COS_OFFSET		= SIN_TABLE_SIZE / 4;
+constexpr double PHASE_FULL_TURN	= 4294967296.0;
+constexpr double PI					= 3.14159265358979323846;
+constexpr float IQ_SCALE			= 127.0f;
+
+struct SinTable
+{
+	float values[SIN_TABLE_SIZE];		//For dithered output
+	int32_t quantized[SIN_TABLE_SIZE];	//For gathers
+	int8_t quantized8[SIN_TABLE_SIZE];
+
+	SinTable()
+	{
+		for (uint32_t i = 0; i < SIN_TABLE_SIZE; i++)
+		{
+			values[i] = (float)sin(2.0 * PI * i / SIN_TABLE_SIZE);
+			quantized[i] = (int32_t)lrintf(values[i] * IQ_SCALE);
+			quantized8[i] = (int8_t)quantized[i];
+		}
+	}
+};
+
+static const SinTable& sinTable()
+{
+	static const SinTable table;
+	return table;
+}
+
+static inline int8_t quantize(float value, uint32_t& dither)
+{
+	//Triangular dither of +-1 LSB from two uniform values of cheap LCG
+	dither = dither * 1664525u + 1013904223u;
+	float r1 = float(dither >> 8) * (1.0f / 16777216.0f);
+	dither = dither * 1664525u + 1013904223u;
+	float r2 = float(dither >> 8) * (1.0f / 16777216.0f);
+
+	long q = lrintf(value * IQ_SCALE + r1 - r2);
+	return (int8_t)(q > 127 ? 127 : (q < -127 ? -127 : q));
+}
+
+static inline void lookup(HackRF_Modulator::Phase_t phase, int8_t* iq, uint32_t* dither)
+{
+	const SinTable& table = sinTable();
+	uint32_t idx = phase >> SIN_TABLE_SHIFT;
+	uint32_t cosIdx = (idx + COS_OFFSET) & SIN_TABLE_MASK;
+	if (dither)
+	{
+		iq[0] = quantize(table.values[idx], *dither);
+		iq[1] = quantize(table.values[cosIdx], *dither);
+	}
+	else
+	{
+		iq[0] = table.quantized8[idx];
+		iq[1] = table.quantized8[cosIdx];
+	}
+}
+
+static inline float clip(float amp)
+{
+	return amp > 1.0f ? 1.0f : (amp < -1.0f ? -1.0f : amp);
+}
+
+static void fmScalar(const float* audio, size_t count, float gain, float deviationScale, HackRF_Modulator::Phase_t& phase, int8_t* iq, uint32_t* dither)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		phase += (uint32_t)lrintf(clip(audio[i] * gain) * deviationScale);
+		lookup(phase, &iq[i * 2], dither);
+	}
+}
+
+#ifdef HACKRF_SSE2
+static void fmSSE2(const float* audio, size_t count, float gain, float deviationScale, HackRF_Modulator::Phase_t& phase, int8_t* iq)
+{
+	const int8_t* table = sinTable().quantized8;
+	const __m128 vGain = _mm_set1_ps(gain);
+	const __m128 vScale = _mm_set1_ps(deviationScale);
+	const __m128 vOne = _mm_set1_ps(1.0f);
+	const __m128 vMinusOne = _mm_set1_ps(-1.0f);
+	alignas(16) uint32_t idx[4];
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 amp = _mm_mul_ps(_mm_loadu_ps(&audio[i]), vGain);
+		amp = _mm_min_ps(_mm_max_ps(amp, vMinusOne), vOne);
+		__m128i inc = _mm_cvtps_epi32(_mm_mul_ps(amp, vScale));
+
+		//Prefix sum of increments gives phase of every sample
+		inc = _mm_add_epi32(inc, _mm_slli_si128(inc, 4));
+		inc = _mm_add_epi32(inc, _mm_slli_si128(inc, 8));
+		__m128i ph = _mm_add_epi32(inc, _mm_set1_epi32((int)phase));
+		_mm_store_si128((__m128i*)idx, _mm_srli_epi32(ph, SIN_TABLE_SHIFT));
+		phase = (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(ph, 0xFF));
+
+		int8_t* out = &iq[i * 2];
+		for (int k = 0; k < 4; k++)
+		{
+			out[k * 2] = table[idx[k]];
+			out[k * 2 + 1] = table[(idx[k] + COS_OFFSET) & SIN_TABLE_MASK];
+		}
+	}
+
+	fmScalar(&audio[i], count - i, gain, deviationScale, phase, &iq[i * 2], nullptr);
+}
+#endif
+
+#ifdef HACKRF_X86
+HACKRF_TARGET_AVX2
+static void fmAVX2(const float* audio, size_t count, float gain, float deviationScale, HackRF_Modulator::Phase_t& phase, int8_t* iq)
+{
+	const int32_t* table = sinTable().quantized;
+	const __m256 vGain = _mm256_set1_ps(gain);
+	const __m256 vScale = _mm256_set1_ps(deviationScale);
+	const __m256 vOne = _mm256_set1_ps(1.0f);
+	const __m256 vMinusOne = _mm256_set1_ps(-1.0f);
+	const __m256i vCosOffset = _mm256_set1_epi32(COS_OFFSET);
+	const __m256i vMask = _mm256_set1_epi32(SIN_TABLE_MASK);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 amp = _mm256_mul_ps(_mm256_loadu_ps(&audio[i]), vGain);
+		amp = _mm256_min_ps(_mm256_max_ps(amp, vMinusOne), vOne);
+		__m256i inc = _mm256_cvtps_epi32(_mm256_mul_ps(amp, vScale));
+
+		//Prefix sum inside of each 128bit lane, then carry the low lane total into the high lane
+		inc = _mm256_add_epi32(inc, _mm256_slli_si256(inc, 4));
+		inc = _mm256_add_epi32(inc, _mm256_slli_si256(inc, 8));
+		__m256i carry = _mm256_shuffle_epi32(inc, 0xFF);
+		carry = _mm256_permute2x128_si256(carry, carry, 0x08);
+		inc = _mm256_add_epi32(inc, carry);
+
+		__m256i ph = _mm256_add_epi32(inc, _mm256_set1_epi32((int)phase));
+		phase = (uint32_t)_mm256_extract_epi32(ph, 7);
+
+		__m256i idx = _mm256_srli_epi32(ph, SIN_TABLE_SHIFT);
+		__m256i vs = _mm256_i32gather_epi32(table, idx, 4);
+		__m256i vc = _mm256_i32gather_epi32(table, _mm256_and_si256(_mm256_add_epi32(idx, vCosOffset), vMask), 4);
+
+		//Interleave I/Q and narrow 32 -> 16 -> 8 bits with saturation. Lanes end up in order: s0 c0 .. s3 c3 | s4 c4 .. s7 c7
+		__m256i iq16 = _mm256_packs_epi32(_mm256_unpacklo_epi32(vs, vc), _mm256_unpackhi_epi32(vs, vc));
+		__m256i iq8 = _mm256_packs_epi16(iq16, iq16);
+		iq8 = _mm256_permute4x64_epi64(iq8, 0x08);
+		_mm_storeu_si128((__m128i*)&iq[i * 2], _mm256_castsi256_si128(iq8));
+	}
+
+	fmScalar(&audio[i], count - i, gain, deviationScale, phase, &iq[i * 2], nullptr);
+}
+#endif
+
+int32_t HackRF_Modulator::PhaseIncrement(double hz, double sampleRate)
+{
+	return (int32_t)llround(hz / sampleRate * PHASE_FULL_TURN);
+}
+
+float HackRF_Modulator::DeviationScale(double deviationHz, double sampleRate)
+{
+	return (float)(deviationHz / sampleRate * PHASE_FULL_TURN);
+}
+
+void HackRF_Modulator::FM(const float* audio, size_t count, float gain, float deviationScale, Phase_t& phase, int8_t* iq, uint32_t* dither)
+{
+	if (dither)
+		return fmScalar(audio, count, gain, deviationScale, phase, iq, dither);
+#ifdef HACKRF_X86
+	if (HackRF_CPU::HasAVX2())
+		return fmAVX2(audio, count, gain, deviationScale, phase, iq);
+#endif
+#ifdef HACKRF_SSE2
+	return fmSSE2(audio, count, gain, deviationScale, phase, iq);
+#else
+	return fmScalar(audio, count, gain, deviationScale, phase, iq, nullptr);
+#endif
+}
+
+void HackRF_Modulator::Tone(size_t count, int32_t increment, Phase_t& phase, int8_t* iq, uint32_t* dither)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		phase += (uint32_t)increment;
+		lookup(phase, &iq[i * 2], dither);
+	}
+}
+
+void HackRF_Modulator::AM(const float* audio, size_t count, float gain, int8_t* iq, uint32_t* dither)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		float amp = clip(audio[i] * gain);
+		iq[i * 2] = dither ? quantize(amp, *dither) : (int8_t)lrintf(amp * IQ_SCALE);
+		iq[i * 2 + 1] = 0;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+/*
+*  Subject: HackRF_Modulator
+*  Purpose: Numerically controlled oscillator and FM modulator kernels for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Phase is a 32bit fixed point accumulator where full turn is 2^32, so it wraps around for free.
+//Sine and cosine are taken from lookup table. FM kernel is vectorized with SSE2 or AVX2 (chosen at runtime).
+//Output is interleaved int8 I/Q: sin(phase), cos(phase), ready to be sent to HackRF as is.
+//If dither state is passed, triangular dither is added before rounding (scalar path only).
+class HackRF_Modulator
+{
+public:
+	using Phase_t = uint32_t;
+
+	//Phase increment per sample of tone with given frequency offset
+	static int32_t PhaseIncrement(double hz, double sampleRate);
+
+	//Phase units per sample for audio amplitude 1.0
+	static float DeviationScale(double deviationHz, double sampleRate);
+
+	//FM modulation of audio. Amplitude is multiplied by gain and clipped to [-1, 1].
+	static void FM(const float* audio, size_t count, float gain, float deviationScale, Phase_t& phase, int8_t* iq, uint32_t* dither = nullptr);
+
+	//Constant tone (or carrier if increment is 0)
+	static void Tone(size_t count, int32_t increment, Phase_t& phase, int8_t* iq, uint32_t* dither = nullptr);
+
+	//AM modulation of audio. Amplitude is multiplied by gain and clipped to [-1, 1].
+	static void AM(const float* audio, size_t count, float gain, int8_t* iq, uint32_t* dither = nullptr);
+};
@@ -9,135 +9,246 @@
 */
 
 #include "HackRF_PCMSource.h"
+#include "HackRF_CPU.h"
 #include <stdexcept>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
 
-#define WAVE_FORMAT_PCM		1
+constexpr size_t DECODE_BLOCK_FRAMES = 65536;
 
-static inline int16_t pcm8to16bit(int8_t sample)
+//Samples are scaled as 16 bit ones divided by 65530, wider formats keep their extra precision.
+//8 bit WAV samples are unsigned with 128 as zero.
+template <int Bytes>
+struct PCMFormat;
+
+template <>
+struct PCMFormat<1>
 {
-    constexpr int16_t mult = 32767 / 255;
-    return sample * mult;
-}
+    static constexpr float scale = float(256.0 / 65530);
+    static int32_t Read(const uint8_t* in) { return int32_t(in[0]) - 128; }
+};
 
-static inline int16_t pcm32to16bit(int32_t sample)
+template <>
+struct PCMFormat<2>
 {
-    constexpr int32_t mult = 2147483647 / 32767;
-    return sample / mult;
+    static constexpr float scale = float(1.0 / 65530);
+    static int32_t Read(const uint8_t* in) { return int16_t(in[0] | (in[1] << 8)); }
+};
+
+template <>
+struct PCMFormat<3>
+{
+    static constexpr float scale = float(1.0 / 65530 / 256);
+    static int32_t Read(const uint8_t* in) { return int32_t(uint32_t(in[0]) << 8 | uint32_t(in[1]) << 16 | uint32_t(in[2]) << 24) >> 8; }
+};
+
+template <>
+struct PCMFormat<4>
+{
+    static constexpr float scale = float(1.0 / 65530 / 65536);
+    static int32_t Read(const uint8_t* in) { return int32_t(uint32_t(in[0]) | uint32_t(in[1]) << 8 | uint32_t(in[2]) << 16 | uint32_t(in[3]) << 24); }
+};
+
+//SIMD kernels below give bit exact results of these
+template <int Bytes>
+static void decodeMono(const uint8_t* in, size_t count, float* out)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = (float)PCMFormat<Bytes>::Read(in + i * Bytes) * PCMFormat<Bytes>::scale;
 }
 
-static inline int16_t pcm24to16bit(int32_t sample)
+template <int Bytes>
+static void decodeStereo(const uint8_t* in, size_t count, float* out)
 {
-    constexpr int32_t mult = 8388607 / 32767;
-    return sample / mult;
+    const float scale = PCMFormat<Bytes>::scale * 0.5f;
+    for (size_t i = 0; i < count; i++)
+        out[i] = ((float)PCMFormat<Bytes>::Read(in + i * Bytes * 2) + (float)PCMFormat<Bytes>::Read(in + i * Bytes * 2 + Bytes)) * scale;
 }
 
-static void wavRead32FromMemory(const unsigned char* in, size_t inSize, uint16_t channels, std::vector<float>& out,
-    size_t start, size_t sampleCount, uint16_t byterate)
+#ifdef HACKRF_SSE2
+//4 samples to float, not scaled. 24 bit is left to AVX2 and scalar code, it needs byte shuffle.
+template <int Bytes>
+static __m128 load4(const uint8_t* in);
+
+template <>
+__m128 load4<1>(const uint8_t* in)
 {
-    unsigned char bufi[8];
-    size_t off = start;
-    auto readNext = [&in, &bufi, &off, &inSize](size_t itemSize, size_t count)
-    {
-        size_t i = 0;
-        for (i = 0; i < count * itemSize && i + off < inSize; i++)
-            bufi[i] = in[i + off];
-        off += i;
+    const __m128i zero = _mm_setzero_si128();
+    int32_t bytes;
+    memcpy(&bytes, in, sizeof(bytes));
+    __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+    return _mm_cvtepi32_ps(_mm_sub_epi32(v, _mm_set1_epi32(128)));
+}
 
-        return i / itemSize;
-    };
+template <>
+__m128 load4<2>(const uint8_t* in)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i*)in);
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
 
-    size_t step = channels;
-    int8_t i8;
-    int16_t i16;
-    int32_t i32;
+template <>
+__m128 load4<4>(const uint8_t* in)
+{
+    return _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)in));
+}
 
-    auto makeSample = [&]()
+template <int Bytes>
+static void decodeSSE2(const uint8_t* in, size_t count, uint16_t channels, float* out)
+{
+    const __m128 scale = _mm_set1_ps(channels > 1 ? PCMFormat<Bytes>::scale * 0.5f : PCMFormat<Bytes>::scale);
+    size_t i = 0;
+    if (channels > 1)
     {
-        switch (byterate)
+        for (; i + 4 <= count; i += 4)
         {
-        case 1:
-            i8 = ((int8_t*)bufi)[0];
-            i16 = pcm8to16bit(i8);
-            break;
-
-        case 2:
-            i16 = ((int16_t*)bufi)[0];
-            break;
-
-        case 3:
-            i32 = bufi[0] | (bufi[1] << 8) | (bufi[2] << 16);
-            if (i32 & 0x800000)
-                i32 |= 0x80000000;
-            i16 = pcm24to16bit(i32);
-            break;
-
-        case 4:
-            i32 = ((int32_t*)bufi)[0];
-            i16 = pcm32to16bit(i32);
-            break;
+            //Sum of neighbour samples: l0+r0 l1+r1 | l2+r2 l3+r3
+            __m128 a = load4<Bytes>(in + i * Bytes * 2);
+            __m128 b = load4<Bytes>(in + i * Bytes * 2 + Bytes * 4);
+            __m128 sum = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_ps(&out[i], _mm_mul_ps(sum, scale));
         }
-    };
-    
-    size_t i = 0;
-    for  (i = 0; i < sampleCount; i += step)
+        decodeStereo<Bytes>(in + i * Bytes * 2, count - i, &out[i]);
+    }
+    else
     {
-        if (readNext(byterate, 1) != 1)
-            break;
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(&out[i], _mm_mul_ps(load4<Bytes>(in + i * Bytes), scale));
+        decodeMono<Bytes>(in + i * Bytes, count - i, &out[i]);
+    }
+}
+#endif
 
-        makeSample();
+#ifdef HACKRF_X86
+//8 samples to float, not scaled. Reads 4 bytes more than 8 packed 24 bit samples take.
+template <int Bytes>
+static __m256 load8(const uint8_t* in);
 
-        //Make mono
-        if (channels > 1)
-        {
-            if (readNext(byterate, 1) != 1)
-                break;
+template <>
+HACKRF_TARGET_AVX2 __m256 load8<1>(const uint8_t* in)
+{
+    __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)in));
+    return _mm256_cvtepi32_ps(_mm256_sub_epi32(v, _mm256_set1_epi32(128)));
+}
+
+template <>
+HACKRF_TARGET_AVX2 __m256 load8<2>(const uint8_t* in)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)in)));
+}
+
+template <>
+HACKRF_TARGET_AVX2 __m256 load8<3>(const uint8_t* in)
+{
+    //Each lane takes 4 samples (12 bytes), bytes go to the top of 32 bit words and arithmetic shift extends sign
+    const __m256i shuffle = _mm256_setr_epi8(
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)in)), _mm_loadu_si128((const __m128i*)(in + 12)), 1);
+    return _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_shuffle_epi8(v, shuffle), 8));
+}
+
+template <>
+HACKRF_TARGET_AVX2 __m256 load8<4>(const uint8_t* in)
+{
+    return _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)in));
+}
 
-            float fs1 = (float)i16 / 65530;
-            makeSample();
-            float fs2 = (float)i16 / 65530;
-            out[i / channels] = ((fs1 + fs2) / 2.0f);
+template <int Bytes>
+HACKRF_TARGET_AVX2
+static void decodeAVX2(const uint8_t* in, size_t count, uint16_t channels, float* out)
+{
+    constexpr size_t overread = Bytes == 3 ? 4 : 0;
+    const __m256 scale = _mm256_set1_ps(channels > 1 ? PCMFormat<Bytes>::scale * 0.5f : PCMFormat<Bytes>::scale);
+    size_t i = 0;
+    if (channels > 1)
+    {
+        for (; (i + 8) * Bytes * 2 + overread <= count * Bytes * 2; i += 8)
+        {
+            //Pairwise sums come in 128 bit halves: a01 a23 b01 b23 | a45 a67 b45 b67, put halves in order
+            __m256 a = load8<Bytes>(in + i * Bytes * 2);
+            __m256 b = load8<Bytes>(in + i * Bytes * 2 + Bytes * 8);
+            __m256 sum = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_hadd_ps(a, b)), 0xD8));
+            _mm256_storeu_ps(&out[i], _mm256_mul_ps(sum, scale));
         }
-        else
-            out[i] = ((float)i16 / 65530);
+        decodeStereo<Bytes>(in + i * Bytes * 2, count - i, &out[i]);
+    }
+    else
+    {
+        for (; (i + 8) * Bytes + overread <= count * Bytes; i += 8)
+            _mm256_storeu_ps(&out[i], _mm256_mul_ps(load8<Bytes>(in + i * Bytes), scale));
+        decodeMono<Bytes>(in + i * Bytes, count - i, &out[i]);
     }
 }
+#endif
 
-HackRF_PCMSource::HackRF_PCMSource(const std::string& fileName)
+template <int Bytes>
+static void decode(const uint8_t* in, size_t count, uint16_t channels, float* out)
 {
-    FILE* file;
-    if (!(file = fopen(fileName.c_str(), "rb")))
-        throw std::runtime_error("Cannot open wav file");
+#ifdef HACKRF_X86
+    if (HackRF_CPU::HasAVX2())
+        return decodeAVX2<Bytes>(in, count, channels, out);
+#endif
+#ifdef HACKRF_SSE2
+    if constexpr (Bytes != 3)
+        return decodeSSE2<Bytes>(in, count, channels, out);
+#endif
+    if (channels > 1)
+        decodeStereo<Bytes>(in, count, out);
+    else
+        decodeMono<Bytes>(in, count, out);
+}
 
-	std::vector<uint8_t> buf;
-    fseek(file, 0L, SEEK_END);
-    uint32_t sz = ftell(file);
-    buf.resize(sz);
+void HackRF_PCMSource::Decode(const void* frames, size_t frameCount, uint16_t channels, uint16_t byterate, float* out)
+{
+    const uint8_t* in = (const uint8_t*)frames;
+    switch (byterate)
+    {
+    case 1:
+        return decode<1>(in, frameCount, channels, out);
+    case 2:
+        return decode<2>(in, frameCount, channels, out);
+    case 3:
+        return decode<3>(in, frameCount, channels, out);
+    case 4:
+        return decode<4>(in, frameCount, channels, out);
+    }
+    throw std::runtime_error("Unsupported bitrate");
+}
 
-    rewind(file);
-    if (fread(&buf[0], sz, 1, file) != 1)
-        throw std::runtime_error("Cannot read wav file");
-	
-    fclose(file);
-	_makeBuffer(buf);
+HackRF_PCMSource::HackRF_PCMSource(const std::string& fileName)
+{
+    //Decoded right from the mapping, file is never read into memory as a whole
+    HackRF_WaveFile file(fileName);
+    _decode(file.GetSamples(), file.GetFormat(), &file);
 }
 
 HackRF_PCMSource::HackRF_PCMSource(const void* sampleBufferRaw, size_t bufSize, uint32_t sampleRate, uint32_t bitrate, uint16_t channels)
 {
-    if (channels > 2)
+    if (channels == 0 || channels > 2)
         throw std::runtime_error("Unsupported channel number (supported only mono and stereo)");
 
-    if (bitrate > 32 || bitrate % 8 != 0)
+    if (bitrate == 0 || bitrate > 32 || bitrate % 8 != 0)
         throw std::runtime_error("Unsupported bitrate");
 
     uint16_t byterate = bitrate / 8;
     if (bufSize % byterate != 0)
         throw std::runtime_error("Buffer size not matching it's bitrate");
 
-    m_samplingRate = sampleRate;
-    size_t sampleCount = bufSize / byterate;
-    m_buf.resize(sampleCount / channels);
-    wavRead32FromMemory((unsigned char*)sampleBufferRaw, bufSize, channels, m_buf, 44, sampleCount, byterate);
+    //Raw buffer has no header, samples start at its first byte
+    HackRF_WaveFile::Format_t format;
+    format.channels = channels;
+    format.sampleRate = sampleRate;
+    format.byterate = byterate;
+    format.dataSize = bufSize;
+    _decode((const uint8_t*)sampleBufferRaw, format);
+}
+
+HackRF_PCMSource::HackRF_PCMSource(std::vector<float>&& samples, uint32_t sampleRate)
+    : m_buf(HackRF_ChunkPool::Share(std::move(samples)))
+    , m_samplingRate(sampleRate)
+{
 }
 
 HackRF_PCMSource::~HackRF_PCMSource()
@@ -150,6 +261,12 @@ uint32_t HackRF_PCMSource::GetSamplingRate() const
 }
 
 const std::vector<float>& HackRF_PCMSource::GetRawBuf() const
+{
+    static const std::vector<float> empty;
+    return m_buf ? *m_buf : empty;
+}
+
+const HackRF_ChunkPool::Shared_t& HackRF_PCMSource::GetSharedBuf() const
 {
     return m_buf;
 }
@@ -161,29 +278,27 @@ HackRF_PCMSource::HackRF_PCMSource(const std::vector<uint8_t>& buf)
 
 void HackRF_PCMSource::_makeBuffer(const std::vector<uint8_t>& buf)
 {
-	if (buf[0] != 'R' || buf[1] != 'I' || buf[2] != 'F' || buf[3] != 'F' || buf.size() < 44)
-		throw std::runtime_error("This is not a WAVE file or buffer.");
-
-	uint16_t pcm = *reinterpret_cast<const uint16_t*>(&buf[20]);
-	
-	if (pcm != WAVE_FORMAT_PCM)
-		throw std::runtime_error("This is not PCM wave format. Other formats is unsupported.");
-
-	uint16_t channels = *reinterpret_cast<const uint16_t*>(&buf[22]);
-    m_samplingRate = *reinterpret_cast<const uint32_t*>(&buf[24]);
-	//m_pcmHeader.sampleBytePerSec = *reinterpret_cast<const uint32_t*>(&buf[28]);
-	uint16_t bitrate = *reinterpret_cast<const uint16_t*>(&buf[34]);
-    uint16_t byterate = bitrate / 8;
-
-    if (channels > 2)
-        throw std::runtime_error("Unsupported channel number (supported only mono and stereo)");
+    auto format = HackRF_WaveFile::Parse(buf.data(), buf.size());
+    _decode(buf.data() + format.dataOffset, format);
+}
 
-    if (bitrate > 32 || bitrate % 8 != 0)
-        throw std::runtime_error("Unsupported bitrate");
+void HackRF_PCMSource::_decode(const uint8_t* samples, const HackRF_WaveFile::Format_t& format, HackRF_WaveFile* file)
+{
+    const size_t frames = format.Frames();
+    const size_t frameBytes = format.FrameBytes();
+    m_samplingRate = format.sampleRate;
+    m_buf.reset(); //Old storage goes to pool and may be taken right below
+    auto out = HackRF_ChunkPool::Take(frames);
+    out.resize(frames);
+
+    //Decoded pages of mapped file are released on the go, so peak memory is about the size of float samples only
+    for (size_t first = 0; first < frames; first += DECODE_BLOCK_FRAMES)
+    {
+        size_t count = std::min(DECODE_BLOCK_FRAMES, frames - first);
+        Decode(samples + first * frameBytes, count, format.channels, format.byterate, &out[first]);
+        if (file)
+            file->Release(format.dataOffset + first * frameBytes, count * frameBytes);
+    }
 
-	size_t sampleCount = (buf.size() - 44) / byterate;
-    m_buf.clear();
-    m_buf.resize(sampleCount / channels);
-    wavRead32FromMemory(&buf[0], buf.size(), channels, m_buf, 44, sampleCount, byterate);
+    m_buf = HackRF_ChunkPool::Share(std::move(out));
 }
-
@@ -10,18 +10,24 @@
 *  Comment: Free to use if you credit me in your project.
 */
 
+#include "HackRF_ChunkPool.h"
+#include "HackRF_WaveFile.h"
 #include <vector>
 #include <string>
 
 //Push object of this class into transmitter queue to transmit your sound or FSK data.
-//Supported 3 sources of audio: File, Buffered file and Raw samples.
+//Supported 4 sources of audio: File, Buffered file, Raw samples and float samples.
+//Samples are immutable after construction and shared with transmitter queue, so pushing the same source again costs nothing.
 class HackRF_PCMSource
 {
 private:
-	std::vector<float> m_buf;
+	HackRF_ChunkPool::Shared_t m_buf;
 	uint32_t m_samplingRate;
 
 	void _makeBuffer(const std::vector<uint8_t>& buf);
+	void _decode(const uint8_t* samples, const HackRF_WaveFile::Format_t& format, HackRF_WaveFile* file = nullptr);
+
+	friend class HackRF_Benchmark;
 
 	HackRF_PCMSource(const HackRF_PCMSource&) = delete;
 	HackRF_PCMSource& operator=(const HackRF_PCMSource&) = delete;
@@ -35,8 +41,20 @@ public:
 
 	//Build buffer from raw PCM samples and some data about it
 	HackRF_PCMSource(const void* sampleBufferRaw, size_t bufSize, uint32_t sampleRate, uint32_t bitrate, uint16_t channels);
+
+	//Build buffer from normalized float samples (for example from POCSAG::Encoder::encodeSamples). Takes ownership, no conversion is done.
+	HackRF_PCMSource(std::vector<float>&& samples, uint32_t sampleRate);
 	~HackRF_PCMSource();
 
+	//Moved from source is empty
+	HackRF_PCMSource(HackRF_PCMSource&&) noexcept = default;
+	HackRF_PCMSource& operator=(HackRF_PCMSource&&) noexcept = default;
+
 	uint32_t GetSamplingRate() const;
 	const std::vector<float>& GetRawBuf() const;
+	const HackRF_ChunkPool::Shared_t& GetSharedBuf() const;
+
+	//Interleaved little endian PCM frames (unsigned 8, 16, 24 or 32 bit, mono or stereo) to normalized mono float, same as constructors do.
+	//Vectorized with SSE2 or AVX2 (chosen at runtime).
+	static void Decode(const void* frames, size_t frameCount, uint16_t channels, uint16_t byterate, float* out);
 };
\ No newline at end of file
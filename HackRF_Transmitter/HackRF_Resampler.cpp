@@ -0,0 +1,288 @@
+/*
+*  Subject: HackRF_Resampler
+*  Purpose: Arbitrary ratio sample rate converter for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "HackRF_Resampler.h"
+#include "HackRF_CPU.h"
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+constexpr uint32_t MAX_EXACT_PHASES	= 1024;
+constexpr uint32_t DEFAULT_PHASES	= 512;
+constexpr double CUTOFF				= 0.45;		//Of lower Nyquist frequency, cycles per input sample
+constexpr double KAISER_BETA		= 8.0;		//About 80 dB stopband
+constexpr double PI					= 3.14159265358979323846;
+
+struct HackRF_Resampler::Bank
+{
+	uint32_t phases;
+	std::vector<float> coeffs; //TAPS per phase
+
+	Bank(uint32_t phaseCount, double cutoff)
+		: phases(phaseCount)
+		, coeffs(size_t(phaseCount) * TAPS)
+	{
+		auto bessel0 = [](double x)
+		{
+			double sum = 1.0, term = 1.0;
+			for (int k = 1; k < 32; k++)
+			{
+				term *= (x / (2.0 * k)) * (x / (2.0 * k));
+				sum += term;
+			}
+			return sum;
+		};
+
+		for (uint32_t p = 0; p < phases; p++)
+		{
+			float* h = &coeffs[size_t(p) * TAPS];
+			double frac = double(p) / phases;
+			double sum = 0;
+			for (size_t k = 0; k < TAPS; k++)
+			{
+				//Distance of tap from output position in input samples
+				double t = double(k) - double(HALF - 1) - frac;
+				double x = 2.0 * cutoff * t;
+				double sinc = x == 0 ? 1.0 : sin(PI * x) / (PI * x);
+				double w = t / HALF;
+				double window = w * w >= 1.0 ? 0.0 : bessel0(KAISER_BETA * sqrt(1.0 - w * w)) / bessel0(KAISER_BETA);
+				double value = sinc * window;
+				h[k] = (float)value;
+				sum += value;
+			}
+
+			//Unity gain at DC for every phase, otherwise phases ripple
+			for (size_t k = 0; k < TAPS; k++)
+				h[k] = (float)(h[k] / sum);
+		}
+	}
+};
+
+static std::shared_ptr<const HackRF_Resampler::Bank> bankFor(uint32_t phases, double cutoff)
+{
+	static std::mutex mutex;
+	static std::map<std::pair<uint32_t, double>, std::shared_ptr<const HackRF_Resampler::Bank>> banks;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& bank = banks[{ phases, cutoff }];
+	if (!bank)
+		bank = std::make_shared<const HackRF_Resampler::Bank>(phases, cutoff);
+	return bank;
+}
+
+struct Cursor
+{
+	int64_t index;
+	uint64_t frac;
+	uint64_t one;
+	uint64_t stepWhole;
+	uint64_t stepFrac;
+
+	void Advance()
+	{
+		index += (int64_t)stepWhole;
+		frac += stepFrac;
+		if (frac >= one)
+		{
+			frac -= one;
+			index++;
+		}
+	}
+};
+
+static inline float dotScalar(const float* x, const float* h)
+{
+	float sum = 0;
+	for (size_t k = 0; k < HackRF_Resampler::TAPS; k++)
+		sum += x[k] * h[k];
+	return sum;
+}
+
+//Fast path: all taps of every output are inside input. Returns count of written samples.
+#ifndef HACKRF_SSE2
+static size_t firScalar(const float* in, size_t inCount, const float* coeffs, Cursor& c, float* out, size_t outCount, int64_t lead)
+{
+	size_t n = 0;
+	while (n < outCount && c.index - lead + (int64_t)HackRF_Resampler::TAPS <= (int64_t)inCount)
+	{
+		out[n++] = dotScalar(&in[c.index - lead], &coeffs[(c.frac >> 32) * HackRF_Resampler::TAPS]);
+		c.Advance();
+	}
+	return n;
+}
+#endif
+
+#ifdef HACKRF_SSE2
+static size_t firSSE2(const float* in, size_t inCount, const float* coeffs, Cursor& c, float* out, size_t outCount, int64_t lead)
+{
+	size_t n = 0;
+	while (n < outCount && c.index - lead + (int64_t)HackRF_Resampler::TAPS <= (int64_t)inCount)
+	{
+		const float* x = &in[c.index - lead];
+		const float* h = &coeffs[(c.frac >> 32) * HackRF_Resampler::TAPS];
+		__m128 s0 = _mm_mul_ps(_mm_loadu_ps(x), _mm_loadu_ps(h));
+		__m128 s1 = _mm_mul_ps(_mm_loadu_ps(x + 4), _mm_loadu_ps(h + 4));
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(x + 8), _mm_loadu_ps(h + 8)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(x + 12), _mm_loadu_ps(h + 12)));
+		s0 = _mm_add_ps(s0, s1);
+		s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+		s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+		out[n++] = _mm_cvtss_f32(s0);
+		c.Advance();
+	}
+	return n;
+}
+#endif
+
+#ifdef HACKRF_X86
+HACKRF_TARGET_AVX2
+static size_t firAVX2(const float* in, size_t inCount, const float* coeffs, Cursor& c, float* out, size_t outCount, int64_t lead)
+{
+	size_t n = 0;
+	while (n < outCount && c.index - lead + (int64_t)HackRF_Resampler::TAPS <= (int64_t)inCount)
+	{
+		const float* x = &in[c.index - lead];
+		const float* h = &coeffs[(c.frac >> 32) * HackRF_Resampler::TAPS];
+		__m256 s = _mm256_mul_ps(_mm256_loadu_ps(x), _mm256_loadu_ps(h));
+		s = _mm256_fmadd_ps(_mm256_loadu_ps(x + 8), _mm256_loadu_ps(h + 8), s);
+		__m128 q = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+		q = _mm_add_ps(q, _mm_movehl_ps(q, q));
+		q = _mm_add_ss(q, _mm_shuffle_ps(q, q, 1));
+		out[n++] = _mm_cvtss_f32(q);
+		c.Advance();
+	}
+	return n;
+}
+#endif
+
+static size_t fir(const float* in, size_t inCount, const float* coeffs, Cursor& c, float* out, size_t outCount, int64_t lead)
+{
+#ifdef HACKRF_X86
+	if (HackRF_CPU::HasAVX2())
+		return firAVX2(in, inCount, coeffs, c, out, outCount, lead);
+#endif
+#ifdef HACKRF_SSE2
+	return firSSE2(in, inCount, coeffs, c, out, outCount, lead);
+#else
+	return firScalar(in, inCount, coeffs, c, out, outCount, lead);
+#endif
+}
+
+HackRF_Resampler::HackRF_Resampler()
+{
+	SetRates(1, 1);
+}
+
+void HackRF_Resampler::SetRates(uint32_t inRate, uint32_t outRate)
+{
+	if (inRate == 0 || outRate == 0)
+		inRate = outRate = 1;
+
+	uint32_t g = std::gcd(inRate, outRate);
+	uint64_t up = outRate / g;
+	uint64_t down = inRate / g;
+	uint32_t phases = up <= MAX_EXACT_PHASES ? (uint32_t)up : DEFAULT_PHASES;
+
+	//Upsampling keeps whole input band, downsampling has to cut it to output Nyquist
+	double cutoff = CUTOFF * (outRate < inRate ? double(outRate) / inRate : 1.0);
+	m_bank = bankFor(phases, cutoff);
+	m_ratio = double(outRate) / inRate;
+	m_one = uint64_t(phases) << 32;
+	if (phases == up)
+	{
+		//Exact: every output advances by down/up input samples, that is by down phases
+		m_stepWhole = down / up;
+		m_stepFrac = (down % up) << 32;
+	}
+	else
+	{
+		uint64_t step = (uint64_t)llround(double(inRate) / outRate * double(m_one));
+		m_stepWhole = step / m_one;
+		m_stepFrac = step % m_one;
+	}
+
+	Reset();
+}
+
+void HackRF_Resampler::Reset()
+{
+	//First output sample is centered exactly at the first input sample, silence before it
+	m_index = 0;
+	m_frac = 0;
+	m_flushed = 0;
+	memset(m_history, 0, sizeof(m_history));
+}
+
+double HackRF_Resampler::GetRatio() const
+{
+	return m_ratio;
+}
+
+size_t HackRF_Resampler::Process(const float* in, size_t inCount, float* out, size_t outCount, size_t& produced)
+{
+	const float* coeffs = m_bank->coeffs.data();
+	const int64_t lead = HALF - 1; //Taps before the left neighbour of output position
+	Cursor c = { m_index, m_frac, m_one, m_stepWhole, m_stepFrac };
+	produced = 0;
+
+	//Outputs which need history samples, taps are gathered to temporary window
+	while (produced < outCount && c.index - lead < 0 && c.index - lead + (int64_t)TAPS <= (int64_t)inCount)
+	{
+		float window[TAPS];
+		for (int64_t k = 0; k < (int64_t)TAPS; k++)
+		{
+			int64_t pos = c.index - lead + k;
+			window[k] = pos < 0 ? m_history[TAPS + pos] : in[pos];
+		}
+		out[produced++] = dotScalar(window, &coeffs[(c.frac >> 32) * TAPS]);
+		c.Advance();
+	}
+
+	if (c.index - lead >= 0)
+		produced += fir(in, inCount, coeffs, c, &out[produced], outCount - produced, lead);
+
+	//Keep everything if output is not full, first tap of next output is at most TAPS - 1 samples back
+	int64_t first = c.index - lead;
+	size_t consumed = inCount;
+	if (produced == outCount && first < (int64_t)inCount)
+		consumed = first < 0 ? 0 : (size_t)first;
+
+	if (consumed > 0)
+	{
+		float history[TAPS];
+		for (int64_t k = 0; k < (int64_t)TAPS; k++)
+		{
+			int64_t pos = (int64_t)consumed - (int64_t)TAPS + k;
+			history[k] = pos < 0 ? m_history[TAPS + pos] : in[pos];
+		}
+		memcpy(m_history, history, sizeof(m_history));
+	}
+
+	m_index = c.index - (int64_t)consumed;
+	m_frac = c.frac;
+	return consumed;
+}
+
+size_t HackRF_Resampler::Flush(float* out, size_t outCount)
+{
+	static const float zeros[HALF] = {};
+	size_t produced = 0;
+	m_flushed += Process(zeros, HALF - m_flushed, out, outCount, produced);
+	return produced;
+}
+
+bool HackRF_Resampler::Drained() const
+{
+	//Next output would need more than HALF zeros after the last input sample
+	return m_index + (int64_t)m_flushed >= 0;
+}
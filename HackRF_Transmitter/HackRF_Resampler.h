@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+*  Subject: HackRF_Resampler
+*  Purpose: Arbitrary ratio sample rate converter for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+//Polyphase FIR interpolator. Converts audio of any sample rate to device sample rate.
+//Each output sample is a 16 tap windowed sinc filter of input at fractional position, coefficients are taken from
+//precomputed bank of phases. When ratio is out/in = L/M with small L, bank has exactly L phases and position is exact.
+//Otherwise position is 32bit fixed point fraction of one of 512 phases. Banks are shared between instances.
+//Position and filter history are kept between calls, so input can be fed in pieces of any size
+//and output has no seams between subchunks. Inner loop is vectorized with SSE2 or AVX2 (chosen at runtime).
+class HackRF_Resampler
+{
+public:
+	static constexpr size_t TAPS = 16;
+	struct Bank;
+
+private:
+	static constexpr size_t HALF = TAPS / 2;
+
+	std::shared_ptr<const Bank> m_bank;
+	double m_ratio;
+	uint64_t m_one;			//Position units per input sample: phases << 32
+	uint64_t m_stepWhole;	//Input samples per output sample, whole part
+	uint64_t m_stepFrac;	//And fraction in position units
+	int64_t m_index;		//Input sample left of next output sample, relative to first sample of next call
+	uint64_t m_frac;		//Position of next output sample after m_index
+	size_t m_flushed;		//Zeros consumed after end of input
+	float m_history[TAPS];	//Last consumed input samples, m_history[TAPS - 1 - k] is input sample -k
+
+public:
+	HackRF_Resampler();
+
+	//Sets conversion from inRate to outRate and resets state
+	void SetRates(uint32_t inRate, uint32_t outRate);
+	void Reset();
+
+	double GetRatio() const; //Output samples per input sample
+
+	//Writes up to outCount samples to out, stores count of written samples to produced.
+	//Returns count of consumed input samples. Input is consumed entirely unless output is full.
+	size_t Process(const float* in, size_t inCount, float* out, size_t outCount, size_t& produced);
+
+	//Filter is 8 input samples behind. After the last input sample call this until it returns 0 or Drained() is true.
+	size_t Flush(float* out, size_t outCount);
+	bool Drained() const;
+};
@@ -0,0 +1,266 @@
+/*
+*  Subject: HackRF_StreamSource
+*  Purpose: Streams for HackRFTransmitter: WAV file reader, ring fed by producer thread and callback.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "HackRF_StreamSource.h"
+#include "HackRF_PCMSource.h"
+#include "HackRF_WaveFile.h"
+#include <stdexcept>
+#include <algorithm>
+
+constexpr size_t READ_FRAMES		= 16384;		//Frames read from file at once
+
+/*
+*  HackRF_FileStream
+*/
+
+HackRF_FileStream::HackRF_FileStream(const std::string& fileName)
+	: m_file(nullptr)
+	, m_samplingRate(0)
+	, m_channels(0)
+	, m_byterate(0)
+	, m_frames(0)
+	, m_framesLeft(0)
+{
+	if (!(m_file = fopen(fileName.c_str(), "rb")))
+		throw std::runtime_error("Cannot open wav file");
+
+	auto fail = [this](const char* error)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+		throw std::runtime_error(error);
+	};
+
+	//Header is walked by the same parser as mapped file, reading only what it asks for
+	if (fseek(m_file, 0, SEEK_END) != 0)
+		fail("Cannot read wav file");
+	long fileSize = ftell(m_file);
+	if (fileSize < 0)
+		fail("Cannot read wav file");
+
+	HackRF_WaveFile::Format_t format;
+	try
+	{
+		format = HackRF_WaveFile::Parse([this](size_t offset, uint8_t* buffer, size_t count) -> size_t
+		{
+			if (fseek(m_file, long(offset), SEEK_SET) != 0)
+				return 0;
+			return fread(buffer, 1, count, m_file);
+		}, size_t(fileSize));
+	}
+	catch (const std::exception& ex)
+	{
+		fail(ex.what());
+	}
+
+	if (fseek(m_file, long(format.dataOffset), SEEK_SET) != 0)
+		fail("Cannot read wav file");
+
+	m_channels = format.channels;
+	m_samplingRate = format.sampleRate;
+	m_byterate = format.byterate;
+	if (format.sizeUnknown)
+	{
+		//Length is unknown, read until end of file. Recorder can still be writing it.
+		m_frames = 0;
+		m_framesLeft = UINT64_MAX;
+	}
+	else
+	{
+		m_frames = format.Frames();
+		m_framesLeft = m_frames;
+	}
+
+	m_raw.resize(READ_FRAMES * format.FrameBytes());
+}
+
+HackRF_FileStream::~HackRF_FileStream()
+{
+	if (m_file)
+		fclose(m_file);
+}
+
+uint32_t HackRF_FileStream::GetSamplingRate() const
+{
+	return m_samplingRate;
+}
+
+size_t HackRF_FileStream::Read(float* buffer, size_t count)
+{
+	const size_t frameBytes = size_t(m_byterate) * m_channels;
+	size_t done = 0;
+	while (done < count && m_framesLeft > 0)
+	{
+		size_t frames = (size_t)std::min<uint64_t>({ uint64_t(count - done), m_framesLeft, READ_FRAMES });
+		size_t got = fread(m_raw.data(), frameBytes, frames, m_file);
+		HackRF_PCMSource::Decode(m_raw.data(), got, m_channels, m_byterate, buffer + done);
+		done += got;
+		m_framesLeft -= got;
+
+		//End of file or truncated file
+		if (got < frames)
+			m_framesLeft = 0;
+	}
+
+	return done;
+}
+
+bool HackRF_FileStream::IsFinished() const
+{
+	return m_framesLeft == 0;
+}
+
+uint64_t HackRF_FileStream::GetLengthSamples() const
+{
+	return m_frames;
+}
+
+/*
+*  HackRF_RingStream
+*/
+
+HackRF_RingStream::HackRF_RingStream(uint32_t sampleRate, size_t capacitySamples)
+	: m_buf(capacitySamples)
+	, m_head(0)
+	, m_size(0)
+	, m_closed(false)
+	, m_samplingRate(sampleRate)
+	, m_underruns(0)
+{
+	if (capacitySamples == 0)
+		throw std::runtime_error("Ring stream capacity must not be zero.");
+}
+
+//Called with m_mutex locked
+size_t HackRF_RingStream::_write(const float* samples, size_t count)
+{
+	size_t n = std::min(count, m_buf.size() - m_size);
+	size_t tail = (m_head + m_size) % m_buf.size();
+	size_t first = std::min(n, m_buf.size() - tail);
+	std::copy(samples, samples + first, m_buf.begin() + tail);
+	std::copy(samples + first, samples + n, m_buf.begin());
+	m_size += n;
+	return n;
+}
+
+size_t HackRF_RingStream::Write(const float* samples, size_t count)
+{
+	size_t written = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (written < count)
+	{
+		m_cv.wait(lock, [this]() { return m_closed || m_size < m_buf.size(); });
+		if (m_closed)
+			break;
+		written += _write(samples + written, count - written);
+	}
+	return written;
+}
+
+size_t HackRF_RingStream::TryWrite(const float* samples, size_t count)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_closed ? 0 : _write(samples, count);
+}
+
+void HackRF_RingStream::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+	}
+	m_cv.notify_all();
+}
+
+size_t HackRF_RingStream::GetQueuedSamples() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_size;
+}
+
+uint64_t HackRF_RingStream::GetUnderruns() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_underruns;
+}
+
+uint32_t HackRF_RingStream::GetSamplingRate() const
+{
+	return m_samplingRate;
+}
+
+size_t HackRF_RingStream::Read(float* buffer, size_t count)
+{
+	size_t n = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		n = std::min(count, m_size);
+		size_t first = std::min(n, m_buf.size() - m_head);
+		std::copy(m_buf.begin() + m_head, m_buf.begin() + m_head + first, buffer);
+		std::copy(m_buf.begin(), m_buf.begin() + (n - first), buffer + first);
+		m_head = (m_head + n) % m_buf.size();
+		m_size -= n;
+
+		//Worker asks only when it needs samples, so empty ring means gap in transmission
+		if (n == 0 && count != 0 && !m_closed)
+			m_underruns++;
+	}
+
+	if (n != 0)
+		m_cv.notify_all();
+	return n;
+}
+
+bool HackRF_RingStream::IsFinished() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_closed && m_size == 0;
+}
+
+/*
+*  HackRF_CallbackStream
+*/
+
+HackRF_CallbackStream::HackRF_CallbackStream(uint32_t sampleRate, Callback_t callback, uint64_t lengthSamples)
+	: m_callback(std::move(callback))
+	, m_samplingRate(sampleRate)
+	, m_length(lengthSamples)
+	, m_finished(false)
+{
+	if (!m_callback)
+		throw std::runtime_error("Stream callback is not set.");
+}
+
+uint32_t HackRF_CallbackStream::GetSamplingRate() const
+{
+	return m_samplingRate;
+}
+
+size_t HackRF_CallbackStream::Read(float* buffer, size_t count)
+{
+	if (m_finished)
+		return 0;
+
+	size_t written = 0;
+	if (!m_callback(buffer, count, written))
+		m_finished = true;
+
+	return std::min(written, count);
+}
+
+bool HackRF_CallbackStream::IsFinished() const
+{
+	return m_finished;
+}
+
+uint64_t HackRF_CallbackStream::GetLengthSamples() const
+{
+	return m_length;
+}
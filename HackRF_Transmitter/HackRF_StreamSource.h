@@ -0,0 +1,96 @@
+#pragma once
+
+/*
+*  Subject: HackRF_StreamSource
+*  Purpose: Streams for HackRFTransmitter: WAV file reader, ring fed by producer thread and callback.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "IHackRFStream.h"
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <stdio.h>
+
+//Reads PCM WAV file while it is transmitted. Only header is parsed in constructor, so it is ready at once for file of any length.
+class HackRF_FileStream : public IHackRFStream
+{
+private:
+	FILE* m_file;
+	std::vector<uint8_t> m_raw;
+	uint32_t m_samplingRate;
+	uint16_t m_channels;
+	uint16_t m_byterate;
+	uint64_t m_frames;
+	uint64_t m_framesLeft;
+
+	HackRF_FileStream(const HackRF_FileStream&) = delete;
+	HackRF_FileStream& operator=(const HackRF_FileStream&) = delete;
+
+public:
+	HackRF_FileStream(const std::string& fileName);
+	~HackRF_FileStream();
+
+	uint32_t GetSamplingRate() const override;
+	size_t Read(float* buffer, size_t count) override;
+	bool IsFinished() const override;
+	uint64_t GetLengthSamples() const override;
+};
+
+//Bounded ring of float samples. Producer thread writes, transmitter reads. Close() ends the stream after written samples.
+class HackRF_RingStream : public IHackRFStream
+{
+private:
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::vector<float> m_buf;
+	size_t m_head;
+	size_t m_size;
+	bool m_closed;
+	uint32_t m_samplingRate;
+	uint64_t m_underruns;
+
+	size_t _write(const float* samples, size_t count);
+
+public:
+	HackRF_RingStream(uint32_t sampleRate, size_t capacitySamples);
+
+	size_t Write(const float* samples, size_t count);		//Blocks while ring is full. Less than count only if stream was closed.
+	size_t TryWrite(const float* samples, size_t count);	//Writes what fits
+	void Close();
+	size_t GetQueuedSamples() const;
+	uint64_t GetUnderruns() const;							//Reads which got less than asked while stream was open
+
+	uint32_t GetSamplingRate() const override;
+	size_t Read(float* buffer, size_t count) override;
+	bool IsFinished() const override;
+};
+
+//Callback is called from transmitter worker and must not block. It fills buffer, sets written (may be less than count
+//if nothing is ready yet) and returns false when stream is over.
+class HackRF_CallbackStream : public IHackRFStream
+{
+public:
+	using Callback_t = std::function<bool(float* buffer, size_t count, size_t& written)>;
+
+private:
+	Callback_t m_callback;
+	uint32_t m_samplingRate;
+	uint64_t m_length;
+	std::atomic<bool> m_finished;
+
+public:
+	HackRF_CallbackStream(uint32_t sampleRate, Callback_t callback, uint64_t lengthSamples = 0);
+
+	uint32_t GetSamplingRate() const override;
+	size_t Read(float* buffer, size_t count) override;
+	bool IsFinished() const override;
+	uint64_t GetLengthSamples() const override;
+};
@@ -0,0 +1,121 @@
+/*
+*  Subject: HackRF_TxRing
+*  Purpose: Wait-free single producer, single consumer ring of tx buffers for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "HackRF_TxRing.h"
+#include <cstring>
+
+HackRF_TxRing::HackRF_TxRing(size_t slotCount, size_t slotSize)
+	: m_slots(slotCount)
+	, m_slotCount(slotCount)
+	, m_slotSize(slotSize)
+	, m_readOffset(0)
+	, m_allocatedBytes(0)
+	, m_head(0)
+	, m_tail(0)
+{
+}
+
+HackRF_TxRing::~HackRF_TxRing()
+{
+}
+
+size_t HackRF_TxRing::GetSlotCount() const
+{
+	return m_slotCount;
+}
+
+size_t HackRF_TxRing::GetSlotSize() const
+{
+	return m_slotSize;
+}
+
+size_t HackRF_TxRing::Size() const
+{
+	return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
+
+bool HackRF_TxRing::Empty() const
+{
+	return Size() == 0;
+}
+
+size_t HackRF_TxRing::FreeSlots() const
+{
+	return m_slotCount - (m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire));
+}
+
+int8_t* HackRF_TxRing::WriteSlot(size_t n)
+{
+	auto& slot = m_slots[(m_head.load(std::memory_order_relaxed) + n) % m_slotCount];
+	if (!slot)
+	{
+		slot.reset(new int8_t[m_slotSize]);
+		m_allocatedBytes += m_slotSize;
+	}
+
+	return slot.get();
+}
+
+void HackRF_TxRing::Publish(size_t count)
+{
+	m_head.store(m_head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+void HackRF_TxRing::Release()
+{
+	//Consumer touches only published slots, so nothing is in use when ring is empty
+	if (m_allocatedBytes == 0 || !Empty())
+		return;
+
+	for (auto& slot : m_slots)
+		slot.reset();
+	m_allocatedBytes = 0;
+}
+
+size_t HackRF_TxRing::GetAllocatedBytes() const
+{
+	return m_allocatedBytes;
+}
+
+bool HackRF_TxRing::Pop(int8_t* dst, size_t length)
+{
+	size_t tail = m_tail.load(std::memory_order_relaxed);
+	size_t head = m_head.load(std::memory_order_acquire);
+	size_t copied = 0;
+
+	while (copied < length && tail != head)
+	{
+		size_t n = m_slotSize - m_readOffset;
+		if (n > length - copied)
+			n = length - copied;
+
+		memcpy(dst + copied, m_slots[tail % m_slotCount].get() + m_readOffset, n);
+		copied += n;
+		m_readOffset += n;
+
+		if (m_readOffset == m_slotSize)
+		{
+			m_readOffset = 0;
+			m_tail.store(++tail, std::memory_order_release);
+		}
+	}
+
+	if (copied < length)
+		memset(dst + copied, 0, length - copied);
+
+	return copied > 0;
+}
+
+void HackRF_TxRing::Reset()
+{
+	m_head.store(0, std::memory_order_relaxed);
+	m_tail.store(0, std::memory_order_relaxed);
+	m_readOffset = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+*  Subject: HackRF_TxRing
+*  Purpose: Wait-free single producer, single consumer ring of tx buffers for HackRFTransmitter class.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+//Producer is DSP worker thread, consumer is libhackrf tx callback. Neither side ever takes a lock.
+//Indexes are always growing counters, slot is index % slot count. Producer publishes slots with release store of head,
+//consumer frees them with release store of tail. Both counters live on their own cache lines.
+//Memory of slot is allocated by producer on first write and can be released by producer when ring is empty.
+//Consumer may read any length: it continues reading current slot from where it stopped last time.
+class HackRF_TxRing
+{
+private:
+	static constexpr size_t CACHE_LINE = 64;
+
+	std::vector<std::unique_ptr<int8_t[]>> m_slots;
+	size_t m_slotCount;
+	size_t m_slotSize;
+	size_t m_readOffset;	//Consumer only
+	std::atomic<size_t> m_allocatedBytes;
+
+	char m_pad0[CACHE_LINE];
+	std::atomic<size_t> m_head;	//Written by producer only
+	char m_pad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_tail;	//Written by consumer only
+	char m_pad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+
+	HackRF_TxRing(const HackRF_TxRing&) = delete;
+	HackRF_TxRing& operator=(const HackRF_TxRing&) = delete;
+
+public:
+	HackRF_TxRing(size_t slotCount, size_t slotSize);
+	~HackRF_TxRing();
+
+	size_t GetSlotCount() const;
+	size_t GetSlotSize() const;
+	size_t Size() const;	//Published slots not consumed yet
+	bool Empty() const;
+
+	//Producer side
+	size_t FreeSlots() const;
+	int8_t* WriteSlot(size_t n);	//n-th free slot after head. Must be less than FreeSlots().
+	void Publish(size_t count);		//Makes next count written slots visible to consumer
+
+	void Release();					//Frees memory of all slots if ring is empty
+	size_t GetAllocatedBytes() const;
+
+	//Consumer side
+	bool Pop(int8_t* dst, size_t length); //Copies next published bytes into dst, rest is zeroed. Returns false if nothing is published.
+
+	//Only when both producer and consumer are stopped
+	void Reset();
+};
@@ -0,0 +1,216 @@
+/*
+*  Subject: HackRF_VirtualDevice
+*  Purpose: Radio backends without radio: null sink, .cs8 file writer and in-memory loopback.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "HackRF_VirtualDevice.h"
+#include <chrono>
+#include <cstring>
+
+constexpr uint32_t DEFAULT_SAMPLE_RATE = 10000000; //Same as HackRF after power up
+
+HackRF_VirtualDevice::HackRF_VirtualDevice(uint32_t transferSize, double speed)
+	: m_handler(nullptr)
+	, m_running(false)
+	, m_sampleRate(DEFAULT_SAMPLE_RATE)
+	, m_transferred(0)
+	, m_transferSize(transferSize)
+	, m_speed(speed)
+	, m_frequency(0)
+	, m_gain(0)
+	, m_amp(false)
+{
+}
+
+HackRF_VirtualDevice::~HackRF_VirtualDevice()
+{
+	StopTx();
+}
+
+void HackRF_VirtualDevice::_clockThread()
+{
+	using namespace std::chrono;
+
+	std::vector<int8_t> buffer(m_transferSize);
+	auto start = steady_clock::now();
+	uint64_t samples = 0;
+	uint32_t rate = m_sampleRate;
+
+	while (m_running)
+	{
+		m_handler->onData(buffer.data(), m_transferSize);
+		onTransfer(buffer.data(), m_transferSize);
+		m_transferred += m_transferSize;
+
+		if (m_speed <= 0)
+			continue;
+
+		//Rate change restarts the clock, like real device does
+		if (rate != m_sampleRate)
+		{
+			rate = m_sampleRate;
+			start = steady_clock::now();
+			samples = 0;
+		}
+
+		samples += m_transferSize / 2;
+		auto due = start + duration_cast<steady_clock::duration>(duration<double>(samples / (rate * m_speed)));
+		std::this_thread::sleep_until(due);
+	}
+}
+
+void HackRF_VirtualDevice::onTransfer(const int8_t*, uint32_t)
+{
+}
+
+bool HackRF_VirtualDevice::Open(IHackRFData *handler)
+{
+	m_handler = handler;
+	return true;
+}
+
+void HackRF_VirtualDevice::SetFrequency(uint64_t freg)
+{
+	m_frequency = freg;
+}
+
+void HackRF_VirtualDevice::SetGain(float gain)
+{
+	m_gain = gain;
+}
+
+void HackRF_VirtualDevice::SetAMP(bool enableamp)
+{
+	m_amp = enableamp;
+}
+
+void HackRF_VirtualDevice::SetSampleRate(uint32_t sample_rate)
+{
+	if (sample_rate != 0)
+		m_sampleRate = sample_rate;
+}
+
+bool HackRF_VirtualDevice::StartTx()
+{
+	if (m_running || !m_handler)
+		return false;
+
+	m_running = true;
+	m_thread = std::thread(&HackRF_VirtualDevice::_clockThread, this);
+	return true;
+}
+
+bool HackRF_VirtualDevice::StopTx()
+{
+	m_running = false;
+	if (m_thread.joinable())
+		m_thread.join();
+	return true;
+}
+
+void HackRF_VirtualDevice::Close()
+{
+	StopTx();
+	m_handler = nullptr;
+}
+
+bool HackRF_VirtualDevice::IsRunning() const
+{
+	return m_running;
+}
+
+uint64_t HackRF_VirtualDevice::GetFrequency() const
+{
+	return m_frequency;
+}
+
+uint32_t HackRF_VirtualDevice::GetSampleRate() const
+{
+	return m_sampleRate;
+}
+
+uint64_t HackRF_VirtualDevice::GetTransferredBytes() const
+{
+	return m_transferred;
+}
+
+HackRF_FileDevice::HackRF_FileDevice(const std::string& fileName, uint32_t transferSize, double speed)
+	: HackRF_VirtualDevice(transferSize, speed)
+	, m_fileName(fileName)
+{
+}
+
+HackRF_FileDevice::~HackRF_FileDevice()
+{
+	//Clock thread must not call onTransfer of destroyed object
+	StopTx();
+}
+
+bool HackRF_FileDevice::Open(IHackRFData *handler)
+{
+	m_file.open(m_fileName, std::ios::binary | std::ios::trunc);
+	if (!m_file.is_open())
+		return false;
+
+	return HackRF_VirtualDevice::Open(handler);
+}
+
+void HackRF_FileDevice::Close()
+{
+	HackRF_VirtualDevice::Close();
+	m_file.close();
+}
+
+void HackRF_FileDevice::onTransfer(const int8_t* buffer, uint32_t length)
+{
+	m_file.write((const char*)buffer, length);
+}
+
+HackRF_LoopbackDevice::HackRF_LoopbackDevice(size_t maxBytes, uint32_t transferSize, double speed)
+	: HackRF_VirtualDevice(transferSize, speed)
+	, m_maxBytes(maxBytes)
+{
+}
+
+HackRF_LoopbackDevice::~HackRF_LoopbackDevice()
+{
+	StopTx();
+}
+
+void HackRF_LoopbackDevice::onTransfer(const int8_t* buffer, uint32_t length)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_data.insert(m_data.end(), buffer, buffer + length);
+	if (m_maxBytes != 0 && m_data.size() > m_maxBytes)
+		m_data.erase(m_data.begin(), m_data.end() - m_maxBytes);
+}
+
+size_t HackRF_LoopbackDevice::Available() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_data.size();
+}
+
+size_t HackRF_LoopbackDevice::Read(int8_t* buffer, size_t length)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (length > m_data.size())
+		length = m_data.size();
+
+	memcpy(buffer, m_data.data(), length);
+	m_data.erase(m_data.begin(), m_data.begin() + length);
+	return length;
+}
+
+std::vector<int8_t> HackRF_LoopbackDevice::ReadAll()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<int8_t> data;
+	data.swap(m_data);
+	return data;
+}
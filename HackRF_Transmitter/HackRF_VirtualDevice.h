@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+*  Subject: HackRF_VirtualDevice
+*  Purpose: Radio backends without radio: null sink, .cs8 file writer and in-memory loopback.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "IHackRFDevice.h"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <fstream>
+
+//Clocked device: its thread asks handler for tx buffers at configured sample rate, just like libhackrf does.
+//Speed scales the clock: 2.0 runs twice faster than real time, 0 runs as fast as possible.
+//Frequency, gain and amp are only remembered.
+class HackRF_VirtualDevice : public IHackRFDevice
+{
+private:
+	IHackRFData* m_handler;
+	std::thread m_thread;
+	std::atomic<bool> m_running;
+	std::atomic<uint32_t> m_sampleRate;
+	std::atomic<uint64_t> m_transferred;
+	uint32_t m_transferSize;
+	double m_speed;
+	uint64_t m_frequency;
+	float m_gain;
+	bool m_amp;
+
+	void _clockThread();
+
+protected:
+	//Called from clock thread with every tx buffer received from handler
+	virtual void onTransfer(const int8_t* buffer, uint32_t length);
+
+public:
+	HackRF_VirtualDevice(uint32_t transferSize = 262144, double speed = 1.0);
+	virtual ~HackRF_VirtualDevice();
+
+	bool Open(IHackRFData *handler) override;
+	void SetFrequency(uint64_t freg) override;
+	void SetGain(float gain) override;
+	void SetAMP(bool enableamp) override;
+	void SetSampleRate(uint32_t sample_rate) override;
+	bool StartTx() override;
+	bool StopTx() override;
+	void Close() override;
+	bool IsRunning() const override;
+
+	uint64_t GetFrequency() const;
+	uint32_t GetSampleRate() const;
+	uint64_t GetTransferredBytes() const; //Total bytes of I/Q taken from handler
+};
+
+//Discards samples
+class HackRF_NullDevice : public HackRF_VirtualDevice
+{
+public:
+	using HackRF_VirtualDevice::HackRF_VirtualDevice;
+};
+
+//Writes interleaved int8 I/Q (.cs8), readable by inspectrum, GNU Radio, hackrf_transfer -t
+class HackRF_FileDevice : public HackRF_VirtualDevice
+{
+private:
+	std::string m_fileName;
+	std::ofstream m_file;
+
+protected:
+	void onTransfer(const int8_t* buffer, uint32_t length) override;
+
+public:
+	HackRF_FileDevice(const std::string& fileName, uint32_t transferSize = 262144, double speed = 1.0);
+	~HackRF_FileDevice();
+
+	bool Open(IHackRFData *handler) override; //Fails if file can't be created
+	void Close() override;
+};
+
+//Keeps transmitted I/Q in memory until it is read. If maxBytes is not 0, the oldest bytes are dropped beyond it.
+class HackRF_LoopbackDevice : public HackRF_VirtualDevice
+{
+private:
+	mutable std::mutex m_mutex;
+	std::vector<int8_t> m_data;
+	size_t m_maxBytes;
+
+protected:
+	void onTransfer(const int8_t* buffer, uint32_t length) override;
+
+public:
+	HackRF_LoopbackDevice(size_t maxBytes = 0, uint32_t transferSize = 262144, double speed = 1.0);
+	~HackRF_LoopbackDevice();
+
+	size_t Available() const;
+	size_t Read(int8_t* buffer, size_t length); //Returns count of read bytes
+	std::vector<int8_t> ReadAll();
+};
@@ -0,0 +1,247 @@
+/*
+*  Subject: HackRF_WaveFile
+*  Purpose: Read only memory mapping of WAV file and RIFF chunk parser.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "HackRF_WaveFile.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define WAVE_FORMAT_PCM			1
+#define WAVE_FORMAT_EXTENSIBLE	0xFFFE
+
+static inline uint16_t le16(const uint8_t* p)
+{
+	return uint16_t(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t le32(const uint8_t* p)
+{
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+HackRF_WaveFile::HackRF_WaveFile(const std::string& fileName)
+	: m_data(nullptr)
+	, m_size(0)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(nullptr)
+#endif
+{
+#ifdef _WIN32
+	m_file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Cannot open wav file");
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+	{
+		_unmap();
+		throw std::runtime_error("Cannot read wav file");
+	}
+
+	m_size = (size_t)size.QuadPart;
+	if (m_size != 0)
+	{
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping)
+			m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!m_data)
+		{
+			_unmap();
+			throw std::runtime_error("Cannot map wav file");
+		}
+	}
+#else
+	int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw std::runtime_error("Cannot open wav file");
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		throw std::runtime_error("Cannot read wav file");
+	}
+
+	m_size = (size_t)st.st_size;
+	if (m_size != 0)
+	{
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			throw std::runtime_error("Cannot map wav file");
+		}
+		m_data = (const uint8_t*)data;
+		madvise(data, m_size, MADV_SEQUENTIAL);
+	}
+	close(fd); //Mapping keeps file open
+#endif
+
+	try
+	{
+		m_format = Parse(m_data, m_size);
+	}
+	catch (...)
+	{
+		_unmap();
+		throw;
+	}
+}
+
+HackRF_WaveFile::~HackRF_WaveFile()
+{
+	_unmap();
+}
+
+void HackRF_WaveFile::_unmap()
+{
+#ifdef _WIN32
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data)
+		munmap((void*)m_data, m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+const HackRF_WaveFile::Format_t& HackRF_WaveFile::GetFormat() const
+{
+	return m_format;
+}
+
+const uint8_t* HackRF_WaveFile::GetSamples() const
+{
+	return m_data + m_format.dataOffset;
+}
+
+void HackRF_WaveFile::Release(size_t offset, size_t size)
+{
+	if (offset >= m_size)
+		return;
+	size = std::min(size, m_size - offset);
+
+#ifdef _WIN32
+	//Unlocking pages which are not locked removes them from working set
+	VirtualUnlock((void*)(m_data + offset), size);
+#else
+	//Only whole pages inside of range
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t first = (offset + page - 1) / page * page;
+	size_t last = (offset + size) / page * page;
+	if (last > first)
+		madvise((void*)(m_data + first), last - first, MADV_DONTNEED);
+#endif
+}
+
+HackRF_WaveFile::Format_t HackRF_WaveFile::Parse(const uint8_t* data, size_t size)
+{
+	if (!data)
+		throw std::runtime_error("This is not a WAVE file or buffer.");
+
+	return Parse([data](size_t offset, uint8_t* buffer, size_t count)
+	{
+		memcpy(buffer, data + offset, count);
+		return count;
+	}, size);
+}
+
+HackRF_WaveFile::Format_t HackRF_WaveFile::Parse(const Reader_t& read, size_t size)
+{
+	uint8_t riff[12];
+	if (size < sizeof(riff) || read(0, riff, sizeof(riff)) != sizeof(riff) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0)
+		throw std::runtime_error("This is not a WAVE file or buffer.");
+
+	Format_t format;
+	bool haveFormat = false;
+	size_t offset = sizeof(riff);
+	while (size - offset >= 8)
+	{
+		uint8_t chunk[8];
+		if (read(offset, chunk, sizeof(chunk)) != sizeof(chunk))
+			break;
+		size_t chunkSize = le32(chunk + 4);
+		size_t available = size - offset - 8;
+
+		if (memcmp(chunk, "fmt ", 4) == 0)
+		{
+			//Extensible format chunk is 40 bytes, the rest is not needed
+			uint8_t fmt[40];
+			size_t fmtSize = std::min({ chunkSize, available, sizeof(fmt) });
+			if (read(offset + 8, fmt, fmtSize) != fmtSize)
+				throw std::runtime_error("Invalid format chunk of WAVE file.");
+			ParseFormat(fmt, fmtSize, format);
+			haveFormat = true;
+		}
+		else if (memcmp(chunk, "data", 4) == 0)
+		{
+			if (!haveFormat)
+				throw std::runtime_error("WAVE file has no format chunk before data.");
+
+			format.dataOffset = offset + 8;
+			format.sizeUnknown = chunkSize == UNKNOWN_SIZE || chunkSize == 0;
+			format.dataSize = format.sizeUnknown ? available : std::min(chunkSize, available);
+			return format;
+		}
+
+		//Chunks are word aligned
+		size_t next = chunkSize + (chunkSize & 1);
+		if (next > available)
+			break;
+		offset += 8 + next;
+	}
+
+	throw std::runtime_error("WAVE file has no data chunk.");
+}
+
+void HackRF_WaveFile::ParseFormat(const uint8_t* fmt, size_t size, Format_t& format)
+{
+	if (size < 16)
+		throw std::runtime_error("Invalid format chunk of WAVE file.");
+
+	//Extensible format is used by many recorders for 24 bit and multichannel files, sub format tells the real one
+	uint16_t tag = le16(fmt);
+	if (tag == WAVE_FORMAT_EXTENSIBLE && size >= 26)
+		tag = le16(fmt + 24);
+
+	if (tag != WAVE_FORMAT_PCM)
+		throw std::runtime_error("This is not PCM wave format. Other formats is unsupported.");
+
+	uint16_t channels = le16(fmt + 2);
+	uint16_t bitrate = le16(fmt + 14);
+	if (channels == 0 || channels > 2)
+		throw std::runtime_error("Unsupported channel number (supported only mono and stereo)");
+
+	if (bitrate == 0 || bitrate > 32 || bitrate % 8 != 0)
+		throw std::runtime_error("Unsupported bitrate");
+
+	format.channels = channels;
+	format.sampleRate = le32(fmt + 4);
+	format.byterate = bitrate / 8;
+}
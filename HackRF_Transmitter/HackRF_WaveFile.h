@@ -0,0 +1,74 @@
+#pragma once
+
+/*
+*  Subject: HackRF_WaveFile
+*  Purpose: Read only memory mapping of WAV file and RIFF chunk parser.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include <string>
+#include <functional>
+#include <stdint.h>
+#include <stddef.h>
+
+//File is mapped for lifetime of object, samples are decoded right from the mapping without reading file into memory.
+//Parser walks RIFF chunks, so LIST, fact and other chunks before or after data are skipped.
+class HackRF_WaveFile
+{
+public:
+	static constexpr uint32_t UNKNOWN_SIZE = 0xFFFFFFFF; //Data size written by recorders which don't know length in advance
+
+	//Reads count bytes at offset from the beginning of file into buffer, returns count of bytes read.
+	//Parser asks only for ranges inside of file size it was given.
+	using Reader_t = std::function<size_t(size_t offset, uint8_t* buffer, size_t count)>;
+
+	struct Format_t
+	{
+		uint16_t channels = 0;
+		uint32_t sampleRate = 0;
+		uint16_t byterate = 0;		//Bytes of one sample of one channel
+		size_t dataOffset = 0;		//From the beginning of file
+		size_t dataSize = 0;		//Bytes, truncated to what file really has
+		bool sizeUnknown = false;	//Header has UNKNOWN_SIZE or 0, data goes until the end of file
+
+		size_t FrameBytes() const { return size_t(byterate) * channels; }
+		size_t Frames() const { return FrameBytes() ? dataSize / FrameBytes() : 0; }
+	};
+
+private:
+	const uint8_t* m_data;
+	size_t m_size;
+	Format_t m_format;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+
+	void _unmap();
+
+	HackRF_WaveFile(const HackRF_WaveFile&) = delete;
+	HackRF_WaveFile& operator=(const HackRF_WaveFile&) = delete;
+
+public:
+	HackRF_WaveFile(const std::string& fileName);
+	~HackRF_WaveFile();
+
+	const Format_t& GetFormat() const;
+	const uint8_t* GetSamples() const; //First byte of data chunk
+
+	//Range of file is not needed anymore, its pages can leave resident memory. Keeps peak RSS low while decoding large file.
+	void Release(size_t offset, size_t size);
+
+	//Walks RIFF header of WAV file in memory. Throws if it's not PCM WAV which HackRF_PCMSource can decode.
+	static Format_t Parse(const uint8_t* data, size_t size);
+
+	//The same for file which is read on demand: only chunk headers and body of "fmt " are read
+	static Format_t Parse(const Reader_t& read, size_t size);
+
+	//Validates body of "fmt " chunk and fills channels, sample rate and byterate
+	static void ParseFormat(const uint8_t* fmt, size_t size, Format_t& format);
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+*  Subject: IHackRFDevice
+*  Purpose: Radio backend interface for HackRFTransmitter
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "IHackRFData.h"
+#include <stdint.h>
+
+//Backend calls IHackRFData::onData from its own thread every time it needs next tx buffer, while TX is started.
+//HackRFDevice is the real radio, HackRF_VirtualDevice.h has null, file and loopback sinks for machines without radio.
+class IHackRFDevice
+{
+public:
+	virtual ~IHackRFDevice() = default;
+
+public:
+	virtual bool Open(IHackRFData *handler) = 0;
+	virtual void SetFrequency(uint64_t freg) = 0;
+	virtual void SetGain(float gain) = 0;
+	virtual void SetAMP(bool enableamp) = 0;
+	virtual void SetSampleRate(uint32_t sample_rate) = 0;
+	virtual bool StartTx() = 0;
+	virtual bool StopTx() = 0; //True if stream is stopped
+	virtual void Close() = 0;
+	virtual bool IsRunning() const = 0;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+/*
+*  Subject: IHackRFStream
+*  Purpose: Pull source of PCM samples for HackRFTransmitter
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Transmitter worker reads stream subchunk by subchunk while it is transmitted, so only about one subchunk of signal is in memory.
+//Read() is called from worker thread and must not block: if samples are not ready yet, return what you have and the rest
+//of subchunk is sent as unmodulated carrier. HackRF_StreamSource.h has file, ring and callback streams.
+class IHackRFStream
+{
+public:
+	virtual ~IHackRFStream() = default;
+
+public:
+	virtual uint32_t GetSamplingRate() const = 0;
+	virtual size_t Read(float* buffer, size_t count) = 0;	//Normalized mono samples, returns count written
+	virtual bool IsFinished() const = 0;					//True when Read() will never return samples again
+	virtual uint64_t GetLengthSamples() const { return 0; }	//Total length if known, 0 for live streams
+};
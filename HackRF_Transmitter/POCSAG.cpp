@@ -10,12 +10,13 @@
 */
 
 #include "POCSAG.h"
-#include <bitset>
+#include "POCSAG_Internal.h"
+#include <bit>
 #include <stdexcept>
+#include <algorithm>
 #include <chrono>
-#include <sstream>
-#include <iomanip>
-#include <functional>
+#include <ctime>
+#include <cstring>
 
 namespace POCSAG
 {
@@ -29,17 +30,68 @@ namespace POCSAG
 	constexpr uint32_t FRAMES_PER_BATCH = 8;
 	constexpr uint32_t CW_PER_FRAMES = 2;
 	constexpr uint32_t BATCH_SIZE_IN_CW = (FRAMES_PER_BATCH * CW_PER_FRAMES) + 1;
+	constexpr uint32_t CW_PER_BATCH = FRAMES_PER_BATCH * CW_PER_FRAMES; //Without sync codeword
 	constexpr uint32_t BATCH_MESSAGE_MAX_BITS = FRAMES_PER_BATCH * CW_PER_FRAMES * CW_MSG_SIZE_BITS;
 	constexpr uint32_t PREAMBLE_SIZE_BYTES = 72;
 	constexpr uint8_t  PREAMBLE_SEQUENCE = 0xAA; //10101010
 	constexpr uint16_t PCM_AMPLITUDE = 5000;
 	constexpr uint32_t WAVE_FORMAT_PCM = 1;
+	constexpr float PCM_FLOAT_SCALE = 65530.0f; //Same scale as HackRF_PCMSource uses for 16bit samples
+	constexpr size_t WAVE_HEADER_SIZE = 44;
 
 	using Codeword_t = uint32_t;
-	using NumericBuffer_t = std::vector<std::bitset<NUMERIC_CHAR_SIZE_BITS>>;
-	using AlphanumericBuffer_t = std::vector<std::bitset<ALPHANUMERIC_CHAR_SIZE_BITS>>;
 	using utf8char_t = unsigned long;
 
+	//Message bits in order of transmission. First bit is the most significant bit of first word, bits after the end are zero.
+	class MessageBits_t
+	{
+	private:
+		std::vector<uint64_t>& m_words;
+		size_t m_size = 0;
+
+	public:
+		MessageBits_t(std::vector<uint64_t>& storage) //Storage is cleared, but it's capacity is reused
+			: m_words(storage)
+		{
+			m_words.clear();
+		}
+
+		void Reserve(size_t bits)
+		{
+			m_words.reserve((bits + 63) / 64);
+		}
+
+		//Appends lowest bitCount bits of symbol, most significant first
+		void Append(uint32_t symbol, uint32_t bitCount)
+		{
+			const uint32_t used = m_size & 63;
+			const uint64_t value = uint64_t(symbol) & ((uint64_t(1) << bitCount) - 1);
+			if (used == 0)
+				m_words.push_back(0);
+
+			m_words.back() |= (value << (64 - bitCount)) >> used;
+			if (used + bitCount > 64) //Symbol crosses the word boundary
+				m_words.push_back(value << (128 - used - bitCount));
+			m_size += bitCount;
+		}
+
+		//Returns bitCount (up to 32) bits starting from offset, first of them is the most significant
+		uint32_t Get(size_t offset, uint32_t bitCount) const
+		{
+			const size_t index = offset / 64;
+			const uint32_t shift = offset & 63;
+			uint64_t bits = m_words[index] << shift;
+			if (shift + bitCount > 64 && index + 1 < m_words.size())
+				bits |= m_words[index + 1] >> (64 - shift);
+			return uint32_t(bits >> (64 - bitCount));
+		}
+
+		size_t Size() const
+		{
+			return m_size;
+		}
+	};
+
 	/*
 	* Pager message string encoder
 	*/
@@ -77,7 +129,8 @@ namespace POCSAG
 		return true;
 	}
 
-	void enumerateUTF8String(const std::string& u8str, std::function<void(utf8char_t ch, size_t n, size_t cpsz)> callback)
+	template<class Callback>
+	void enumerateUTF8String(const std::string& u8str, Callback callback) //callback(utf8char_t ch, size_t n, size_t cpsz)
 	{
 		size_t n = 0;
 		for (size_t i = 0; i < u8str.length();)
@@ -88,16 +141,16 @@ namespace POCSAG
 			else if ((u8str[i] & 0xe0) == 0xc0) cplen = 2;
 			if ((i + cplen) > u8str.length()) cplen = 1;
 			utf8char_t ch = 0;
-			auto sch = u8str.substr(i, cplen);
 			for (int k = 0; k < cplen; k++)
-				reinterpret_cast<char*>(&ch)[(cplen - 1) - k] = sch[k];
+				reinterpret_cast<char*>(&ch)[(cplen - 1) - k] = u8str[i + k];
 			callback(ch, n, cplen);
 			n++;
 			i += cplen;
 		}
 	}
 
-	std::string encodeString7bit(const std::string& input, Charset charset)
+	//Appends converted input to str
+	void encodeString7bit(const std::string& input, Charset charset, std::string& str)
 	{
 		char cyrLower[33] =
 		{
@@ -131,9 +184,10 @@ namespace POCSAG
 		};
 
 		if (charset == Charset::Raw)
-			return input;
-
-		std::string str;
+		{
+			str += input;
+			return;
+		}
 
 		if (charset == Charset::Latin)
 		{
@@ -196,96 +250,109 @@ namespace POCSAG
 			}
 		}
 		str.push_back(0x0);
+	}
 
+	std::string encodeString7bit(const std::string& input, Charset charset)
+	{
+		std::string str;
+		encodeString7bit(input, charset, str);
 		return str;
 	}
 
 	/*
-	*  Vector utils
+	*  Buffer utils
 	*/
-	void insert32bit(std::vector<unsigned char>& data, uint32_t u)
-	{
-		uint8_t* ptr = reinterpret_cast<uint8_t*>(&u);
-		for (int i = 0; i < 4; i++)
-			data.push_back(ptr[i]);
-	}
-
 	template <typename T>
-	static void append(std::vector<uint8_t>& buf, T data)
+	static void append(uint8_t*& buf, T data)
 	{
-		const uint8_t* bData = reinterpret_cast<const uint8_t*>(&data);
-		for (size_t i = 0; i < sizeof(T); i++)
-			buf.push_back(bData[i]);
+		memcpy(buf, &data, sizeof(T));
+		buf += sizeof(T);
 	}
 
-	static void append(std::vector<uint8_t>& buf, const uint8_t* bytes, size_t count)
+	static void append(uint8_t*& buf, const uint8_t* bytes, size_t count)
 	{
-		for (size_t i = 0; i < count; i++)
-			buf.push_back(bytes[i]);
+		memcpy(buf, bytes, count);
+		buf += count;
 	}
 
 	/*
 	*  PCM utils
 	*/
 
-	template<typename T>
-	static uint8_t getBitReversed(T cw, size_t bit)
+	//Writes WAVE_HEADER_SIZE bytes, samples go right after it
+	static void WriteWaveHeader(uint8_t* wave, size_t sampleCount, uint32_t sampleRate)
 	{
-		uint8_t max = sizeof(T) * 8;
-		T mask = 1;
-		mask <<= (max - 1 - bit);
-		return (cw & mask) > 0 ? 1 : 0;
-	}
-
-
-	static void MakePCM(const std::vector<Encoder::PCMSample_t>& samples, std::vector<uint8_t>& wave, uint32_t sampleRate)
-	{
-		wave.clear();
 		uint16_t wBPS = static_cast<uint16_t>(sizeof(Encoder::PCMSample_t) * 8);
 		append(wave, (const uint8_t*)"RIFF", 4);
-		append<long>(wave, 36 + (int)(samples.size() * sizeof(Encoder::PCMSample_t)));
+		append<uint32_t>(wave, 36 + (uint32_t)(sampleCount * sizeof(Encoder::PCMSample_t)));
 		append(wave, (const uint8_t*)"WAVE", 4);
 		append(wave, (const uint8_t*)"fmt ", 4);
-		append<long>(wave, 16);
+		append<uint32_t>(wave, 16);
 		append<uint16_t>(wave, WAVE_FORMAT_PCM);
 		append<uint16_t>(wave, 1); //Mono
 		append<uint32_t>(wave, sampleRate);
-		append<long>(wave, sampleRate * 1 * (wBPS / 8));
+		append<uint32_t>(wave, sampleRate * 1 * (wBPS / 8));
 		append<uint16_t>(wave, 1 * (wBPS / 8));
 		append<uint16_t>(wave, wBPS);
 		append(wave, (const uint8_t*)"data", 4);
-		append<uint32_t>(wave, (uint32_t)samples.size() * sizeof(Encoder::PCMSample_t));
-		append(wave, reinterpret_cast<const uint8_t*>(&samples[0]), samples.size() * sizeof(Encoder::PCMSample_t));
+		append<uint32_t>(wave, (uint32_t)(sampleCount * sizeof(Encoder::PCMSample_t)));
+	}
+
+	void MakePCM(const std::vector<Encoder::PCMSample_t>& samples, std::vector<uint8_t>& wave, uint32_t sampleRate)
+	{
+		wave.resize(WAVE_HEADER_SIZE + samples.size() * sizeof(Encoder::PCMSample_t));
+		WriteWaveHeader(wave.data(), samples.size(), sampleRate);
+		if (!samples.empty())
+			memcpy(wave.data() + WAVE_HEADER_SIZE, samples.data(), samples.size() * sizeof(Encoder::PCMSample_t));
+	}
+
+	//Samples of modulated raw POCSAG buffer including silence at both ends. Bits take fractional count of samples.
+	static size_t ModulatedSize(size_t rawBytes, uint16_t bps, uint32_t sampleRate)
+	{
+		return size_t(sampleRate / 2) * 2 + size_t(uint64_t(rawBytes) * 8 * sampleRate / bps);
 	}
 
 	/*
 	*  POCSAG utils
 	*/
-	static uint32_t SignFrame(uint32_t in) //CRC and parity bit are added to the end of the frame
+	//BCH(31,21) check bits of data bits which are set in value, at their place in codeword (bits 10..1).
+	//Polynomial division is linear, so check bits of codeword are XOR of check bits of its bytes.
+	constexpr uint32_t bchOf(uint32_t value)
 	{
-		uint32_t cw = in, newCw = in, parity = 0;
-
-		for (int bit = 1; bit <= 21; bit++, cw <<= 1)
+		for (int bit = 1; bit <= 21; bit++, value <<= 1)
 		{
-			if (cw & 0x80000000)
-				cw ^= 0xED200000;
+			if (value & 0x80000000)
+				value ^= 0xED200000;
 		}
+		return value >> 21;
+	}
 
-		newCw |= (cw >> 21);
-		cw = newCw;
-		for (int bit = 1; bit <= 32; bit++, cw <<= 1)
+	struct BCHTable
+	{
+		uint32_t byte[3][256] = {}; //Bits 31..24, 23..16 and 15..11 of codeword
+
+		constexpr BCHTable()
 		{
-			if (cw & 0x80000000)
-				parity++;
+			for (uint32_t v = 0; v < 256; v++)
+			{
+				byte[0][v] = bchOf(v << 24);
+				byte[1][v] = bchOf(v << 16);
+				byte[2][v] = bchOf((v & 0xF8) << 8);
+			}
 		}
+	};
 
-		if (parity % 2)
-			newCw++;
+	static constexpr BCHTable BCH_TABLE;
 
-		return newCw;
+	uint32_t SignFrame(uint32_t in) //CRC and parity bit are added to the end of the frame
+	{
+		//Bits 10..0 are expected to be zero. If they are not, they are XORed into check bits, like bit by bit division did.
+		uint32_t bch = BCH_TABLE.byte[0][in >> 24] ^ BCH_TABLE.byte[1][(in >> 16) & 0xFF] ^ BCH_TABLE.byte[2][(in >> 8) & 0xF8] ^ (in & 0x7FF);
+		uint32_t cw = in | bch;
+		return cw + (std::popcount(cw) & 1); //Even parity
 	}
 
-	static Codeword_t MakeAddressCodeword(RIC addr, Function func)
+	Codeword_t MakeAddressCodeword(RIC addr, Function func)
 	{
 		Codeword_t cw = 0; //First bit is 0, stands for address cw
 		addr >>= 3; //Get rid of the last 3 bits, they will be recovered from frame position in batch
@@ -310,50 +377,20 @@ namespace POCSAG
 		return result >> NUMERIC_CHAR_SIZE_BITS; //Because our nibble number is 4 bit
 	}
 
-	template<class T>
-	static Codeword_t MakeMessageCodeword(const T& msg, size_t& offset, size_t maxBits)
+	static Codeword_t MakeMessageCodeword(const MessageBits_t& msg, size_t& offset, uint32_t charSizeBits)
 	{
-		if (offset >= maxBits || msg.empty())
+		if (offset >= msg.Size())
 			return IDLE_CODEWORD;
 
-		Codeword_t cw = 0;
-		const size_t wordSize = msg[0].size();
-		const size_t count = CW_MSG_SIZE_BITS;
-		size_t cellNum = offset / wordSize;
-		size_t bitIndex = offset - (cellNum * wordSize);
+		const uint32_t count = CW_MSG_SIZE_BITS;
+		const uint32_t counter = (uint32_t)std::min<size_t>(count, msg.Size() - offset);
+		Codeword_t cw = msg.Get(offset, count); //Rest of empty space is already filled with zeroes, that's enough for alphanumeric messages
 
-		size_t counter = 0;
-		for (size_t i = cellNum; i < msg.size() && counter < count && counter + offset < maxBits; i++)
+		if (counter < count && charSizeBits == NUMERIC_CHAR_SIZE_BITS)
 		{
-			auto cell = msg[i];
-			for (size_t j = bitIndex; j < wordSize && counter < count && counter + offset < maxBits; j++)
-			{
-				cw <<= 1;
-				cw |= cell[wordSize - 1 - j] ? 1 : 0;
-				counter++;
-			}
-			bitIndex = 0;
-		}
-
-		if (counter < count)
-		{
-			if (wordSize == NUMERIC_CHAR_SIZE_BITS)
-			{
-				size_t rest = (count - counter) / wordSize;
-				for (size_t i = 0; i < rest; i++)
-				{
-					cw <<= wordSize;
-					cw |= ReverseNum(0xC); //Fill with spaces rest of empty space for numeric messages
-				}
-			}
-			else
-			{
-				for (size_t i = 0; i < count - counter; i++)
-				{
-					cw <<= 1;
-					cw |= 0; //Fill with zeroes rest of empty space for alphanumeric messages
-				}
-			}
+			uint32_t rest = (count - counter) / charSizeBits;
+			for (uint32_t i = 0; i < rest; i++)
+				cw |= Codeword_t(ReverseNum(0xC)) << (i * charSizeBits); //Fill with spaces rest of empty space for numeric messages
 		}
 
 		offset += counter;
@@ -396,46 +433,66 @@ namespace POCSAG
 			throw std::runtime_error("Unknown numeric value.");
 	}
 
-	static NumericBuffer_t EncodeMessageNumeric(const std::string& msg, size_t charSizeBits, size_t& maxBits)
+	static void EncodeMessageNumeric(const std::string& msg, MessageBits_t& encoded)
 	{
-		NumericBuffer_t encoded;
+		encoded.Reserve(msg.length() * NUMERIC_CHAR_SIZE_BITS);
 		for (char c : msg)
 		{
 			if (c == 0 || c == '\r')
 				break;
 			uint8_t n = ConvertToNumeric(c); //Returns already reversed bit order, but char order is normal
-			encoded.push_back(std::bitset<NUMERIC_CHAR_SIZE_BITS>(n));
-			maxBits += NUMERIC_CHAR_SIZE_BITS;
+			encoded.Append(n, NUMERIC_CHAR_SIZE_BITS);
 		}
-		return encoded;
 	}
 
-	static AlphanumericBuffer_t EncodeMessageAlphanumeric(const std::string& msg, size_t charSizeBits, size_t& maxBits)
+	static void EncodeMessageAlphanumeric(const std::string& msg, MessageBits_t& encoded)
 	{
-		AlphanumericBuffer_t encoded;
+		encoded.Reserve((msg.length() + 1) * ALPHANUMERIC_CHAR_SIZE_BITS);
+		uint8_t last = 0;
 		for (char c : msg)
 		{
-			uint8_t n = ReverseChar(c); //Reversed bit order, but character order is normal
-			encoded.push_back(std::bitset<ALPHANUMERIC_CHAR_SIZE_BITS>(n));
-			maxBits += ALPHANUMERIC_CHAR_SIZE_BITS;
+			last = ReverseChar(c); //Reversed bit order, but character order is normal
+			encoded.Append(last, ALPHANUMERIC_CHAR_SIZE_BITS);
 		}
 
 		//Zero character as the end of the message
-		if (encoded.size() > 0 && encoded[encoded.size() - 1].to_ulong() != 0)
-		{
-			encoded.push_back(std::bitset<ALPHANUMERIC_CHAR_SIZE_BITS>(0));
-			maxBits += ALPHANUMERIC_CHAR_SIZE_BITS;
-		}
+		if (encoded.Size() > 0 && last != 0)
+			encoded.Append(0, ALPHANUMERIC_CHAR_SIZE_BITS);
+	}
 
-		return encoded;
+	//Appends all message codewords of single page (without address codeword)
+	static void AppendPageCodewords(std::vector<Codeword_t>& cws, std::vector<uint64_t>& bitStorage, const std::string& msg, Type msgType)
+	{
+		if (msgType == Type::Tone)
+			return;
+
+		const uint32_t charSize = (msgType == Type::Numeric ? NUMERIC_CHAR_SIZE_BITS : ALPHANUMERIC_CHAR_SIZE_BITS);
+		MessageBits_t messageBits(bitStorage);
+		if (msgType == Type::Numeric)
+			EncodeMessageNumeric(msg, messageBits);
+		else
+			EncodeMessageAlphanumeric(msg, messageBits);
+
+		size_t offset = 0;
+		while (offset < messageBits.Size())
+			cws.push_back(MakeMessageCodeword(messageBits, offset, charSize));
+	}
+
+	//Makes all message codewords of single page (without address codeword)
+	void MakePageCodewords(std::vector<Codeword_t>& cws, const std::string& msg, Type msgType)
+	{
+		std::vector<uint64_t> bitStorage;
+		cws.clear();
+		AppendPageCodewords(cws, bitStorage, msg, msgType);
 	}
 
 	/*
 	*  POCSAG Encoder class implementation
 	*/
 
-	Encoder::Encoder(size_t maxBatches, uint32_t sampleRate)
+	Encoder::Encoder(size_t maxBatches, uint32_t sampleRate, uint32_t samplesPerBit)
 		: m_sampleRate(sampleRate)
+		, m_samplesPerBit(samplesPerBit)
 		, m_amplitude(PCM_AMPLITUDE)
 		, m_maxBatches(maxBatches)
 		, m_dateFormat(DateTimePosition::None)
@@ -455,6 +512,21 @@ namespace POCSAG
 		m_sampleRate = sampleRate;
 	}
 
+	uint32_t Encoder::GetSamplesPerBit() const
+	{
+		return m_samplesPerBit;
+	}
+
+	void Encoder::SetSamplesPerBit(uint32_t samplesPerBit)
+	{
+		m_samplesPerBit = samplesPerBit;
+	}
+
+	uint32_t Encoder::GetSampleRate(BPS bps) const
+	{
+		return m_samplesPerBit != 0 ? uint32_t(bps) * m_samplesPerBit : m_sampleRate;
+	}
+
 	Encoder::PCMSample_t Encoder::GetAmplitude() const
 	{
 		return m_amplitude;
@@ -470,64 +542,65 @@ namespace POCSAG
 		m_dateFormat = position;
 	}
 
-	void Encoder::_modulatePOCSAG(std::vector<PCMSample_t>& output, const std::vector<uint8_t>& data, uint16_t bps)
+	template<typename T>
+	size_t Encoder::_modulatePOCSAG(T* output, const uint8_t* data, size_t size, uint16_t bps, uint32_t sampleRate, T high, T low) const
 	{
-		Encoder::PCMSample_t neutralSample = 0;
-		uint32_t samplesPerBit = m_sampleRate / bps;
+		T neutralSample = 0;
+		T* out = output;
 
 		//Some silence at the beginning
-		for (size_t j = 0; j < m_sampleRate / 2; j++)
-			output.push_back(neutralSample);
+		out = std::fill_n(out, sampleRate / 2, neutralSample);
 
-		//Preamble
-		for (size_t i = 0; i < 72; i++)
+		//Bit n ends at sample n * rate / bps of the body. Position is exact integer, so rounding doesn't accumulate
+		//over long messages and every bit is rate / bps samples long in average, not truncated to whole samples.
+		T* const body = out;
+		uint64_t bitsDone = 0;
+		auto writeBits = [&](uint32_t bits) //From the most significant one
 		{
-			uint8_t cw = data[i];
-
-			for (size_t j = 0; j < 8; j++)
+			uint64_t word = uint64_t(bits) << 32;
+			uint32_t left = 32;
+			while (left > 0)
 			{
-				auto bit = getBitReversed(cw, j);
-
-				PCMSample_t sample;
-
-				if (bit == 1)
-					sample = m_amplitude;
-				else
-					sample = -m_amplitude;
-
-				for (size_t j = 0; j < samplesPerBit; j++)
-					output.push_back(sample);
+				//Equal bits are written as single run
+				bool one = (word >> 63) != 0;
+				uint32_t run = std::min<uint32_t>(left, uint32_t(one ? std::countl_one(word) : std::countl_zero(word)));
+				bitsDone += run;
+				T* end = body + bitsDone * sampleRate / bps;
+				out = std::fill_n(out, end - out, one ? high : low);
+				word <<= run;
+				left -= run;
 			}
+		};
 
-		}
+		//Preamble bytes go in order
+		for (size_t i = 0; i < PREAMBLE_SIZE_BYTES; i += 4)
+			writeBits((uint32_t(data[i]) << 24) | (uint32_t(data[i + 1]) << 16) | (uint32_t(data[i + 2]) << 8) | data[i + 3]);
 
 		//Message body
-		for (size_t i = 72; i < data.size(); i += 4)
-		{
-			uint32_t cw = *reinterpret_cast<const uint32_t*>(&data[i]);
-
-			for (size_t j = 0; j < 32; j++)
-			{
-				auto bit = getBitReversed(cw, j);
-
-				PCMSample_t sample;
-
-				if (bit == 1)
-					sample = m_amplitude;
-				else
-					sample = -m_amplitude;
-
-				for (size_t j = 0; j < samplesPerBit; j++)
-					output.push_back(sample);
-			}
-		}
+		for (size_t i = PREAMBLE_SIZE_BYTES; i < size; i += 4)
+			writeBits(*reinterpret_cast<const uint32_t*>(&data[i]));
 
 		//Some silence at the end
-		for (size_t j = 0; j < m_sampleRate / 2; j++)
-			output.push_back(neutralSample);
+		out = std::fill_n(out, sampleRate / 2, neutralSample);
+		return size_t(out - output);
 	}
 
-	std::string MakeDateAndTime()
+	template<typename T>
+	void Encoder::_modulatePOCSAG(std::vector<T>& output, const std::vector<uint8_t>& data, uint16_t bps, T high, T low)
+	{
+		size_t begin = output.size();
+		uint32_t sampleRate = GetSampleRate(BPS(bps));
+		output.resize(begin + ModulatedSize(data.size(), bps, sampleRate));
+		_modulatePOCSAG(output.data() + begin, data.data(), data.size(), bps, sampleRate, high, low);
+	}
+
+	//Benchmark project calls it directly
+	template void Encoder::_modulatePOCSAG<Encoder::PCMSample_t>(std::vector<PCMSample_t>&, const std::vector<uint8_t>&, uint16_t, PCMSample_t, PCMSample_t);
+	template void Encoder::_modulatePOCSAG<float>(std::vector<float>&, const std::vector<uint8_t>&, uint16_t, float, float);
+	template size_t Encoder::_modulatePOCSAG<Encoder::PCMSample_t>(PCMSample_t*, const uint8_t*, size_t, uint16_t, uint32_t, PCMSample_t, PCMSample_t) const;
+	template size_t Encoder::_modulatePOCSAG<float>(float*, const uint8_t*, size_t, uint16_t, uint32_t, float, float) const;
+
+	static void AppendDateAndTime(std::string& output)
 	{
 		// Get current time
 		auto now = std::chrono::system_clock::now();
@@ -535,57 +608,123 @@ namespace POCSAG
 		// Convert to time_t (number of seconds since epoch)
 		auto time_t_now = std::chrono::system_clock::to_time_t(now);
 
-		// Convert to struct tm using localtime_s
+		// Convert to struct tm using thread safe localtime
 		std::tm tm_now;
+#ifdef _WIN32
 		localtime_s(&tm_now, &time_t_now);
+#else
+		localtime_r(&time_t_now, &tm_now);
+#endif
 
 		// Format string
-		std::ostringstream oss;
-		oss << std::put_time(&tm_now, "%d.%m.%Y %H:%M:%S") << " \n";
+		char str[32];
+		size_t len = strftime(str, sizeof(str), "%d.%m.%Y %H:%M:%S \n", &tm_now);
+		output.append(str, len);
+	}
+
+	void Encoder::_prepareMessage(Type msgType, const std::string& msg, Charset charset, std::string& output) const
+	{
+		if (msgType != Type::Alphanumeric)
+		{
+			output = msg;
+			return;
+		}
+
+		//If we want to specify sending date and time in our message than add it according to position
+		output.clear();
+		if (m_dateFormat == DateTimePosition::Begin)
+			AppendDateAndTime(output);
+
+		//Pager 7-bit string encoding
+		encodeString7bit(msg, charset, output);
 
-		return oss.str();
+		if (m_dateFormat == DateTimePosition::End)
+		{
+			output.push_back('\n');
+			AppendDateAndTime(output);
+		}
 	}
 
-	size_t Encoder::encode(std::vector<uint8_t>& output, RIC addr, Type msgType, std::string msg, BPS bps, Charset charset, Function func, bool rawPOCSAG)
+	static size_t RawSize(size_t slotCount)
+	{
+		return PREAMBLE_SIZE_BYTES + (slotCount / CW_PER_BATCH) * BATCH_SIZE_IN_CW * sizeof(Codeword_t);
+	}
+
+	size_t Encoder::_finishPrepare(Workspace_t& ws, BPS bps, Output format) const
 	{
-		if (msgType == Type::Alphanumeric)
+		size_t rawSize = RawSize(ws.slots.size());
+		uint32_t sampleRate = GetSampleRate(bps);
+		size_t samples = ModulatedSize(rawSize, uint16_t(bps), sampleRate);
+
+		ws.bps = uint16_t(bps);
+		ws.sampleRate = sampleRate;
+		ws.format = format;
+		if (format == Output::Raw)
+			ws.size = rawSize;
+		else if (format == Output::Wave)
+			ws.size = WAVE_HEADER_SIZE + samples * sizeof(PCMSample_t);
+		else
+			ws.size = samples;
+
+		ws.prepared = true;
+		return ws.size;
+	}
+
+	static void WriteRaw(const std::vector<Codeword_t>& slots, uint8_t* output)
+	{
+		memset(output, PREAMBLE_SEQUENCE, PREAMBLE_SIZE_BYTES);
+		output += PREAMBLE_SIZE_BYTES;
+
+		for (size_t i = 0; i < slots.size(); i++)
 		{
-			//Pager 7-bit string encoding
-			msg = encodeString7bit(msg, charset);
-
-			//If we want to specify sending date and time in our message than append it according to position
-			if (m_dateFormat == DateTimePosition::Begin)
-				msg = MakeDateAndTime() + msg;
-			else if (m_dateFormat == DateTimePosition::End)
-				msg += "\n" + MakeDateAndTime();
+			if (i % CW_PER_BATCH == 0)
+				append<uint32_t>(output, SYNC_CODEWORD); //Must be at the begining of every batch
+			append<uint32_t>(output, slots[i]);
 		}
+	}
+
+	size_t Encoder::prepare(const Page& page, BPS bps, Output format)
+	{
+		return prepare(m_ws, page, bps, format);
+	}
+
+	size_t Encoder::prepare(const std::vector<Page>& pages, BPS bps, Output format, TransmissionStats* stats)
+	{
+		return prepare(m_ws, pages, bps, format, stats);
+	}
+
+	size_t Encoder::encodeInto(std::span<uint8_t> output)
+	{
+		return encodeInto(m_ws, output);
+	}
+
+	size_t Encoder::encodeInto(std::span<float> output)
+	{
+		return encodeInto(m_ws, output);
+	}
 
-		size_t len = msg.length();
+	size_t Encoder::prepare(Workspace_t& ws, const Page& page, BPS bps, Output format) const
+	{
+		ws.prepared = false;
+		_prepareMessage(page.type, page.message, page.charset, ws.message);
+
+		const RIC addr = page.address;
+		const Type msgType = page.type;
 		size_t charSize = (msgType == Type::Alphanumeric ? ALPHANUMERIC_CHAR_SIZE_BITS : NUMERIC_CHAR_SIZE_BITS); //Bits
-		size_t msgSize = len * charSize;
 		size_t addrFrameNum = addr & 0b111; //Last 3 bits
 
 		if (addr > ADDR_MAX)
 			throw std::runtime_error("Address value is too big.");
 
-		if (!ValidateMessage(msg, msgType))
+		if (!ValidateMessage(ws.message, msgType))
 			throw std::runtime_error("Message is invalid.");
 
-		size_t msgCWCount = msgSize / CW_MSG_SIZE_BITS;
-		if (msgSize % CW_MSG_SIZE_BITS != 0)
-			msgCWCount++;
-		if (msgType == Type::Tone)
-			msgCWCount = 0;
-
-		//We have different containers for numeric of alphanumeric messages
-		NumericBuffer_t messageBitsN;
-		AlphanumericBuffer_t messageBitsA;
-		size_t maxBits = 0;
-
+		MessageBits_t messageBits(ws.bits);
 		if (msgType == Type::Numeric)
-			messageBitsN = EncodeMessageNumeric(msg, charSize, maxBits);
+			EncodeMessageNumeric(ws.message, messageBits);
 		else
-			messageBitsA = EncodeMessageAlphanumeric(msg, charSize, maxBits);
+			EncodeMessageAlphanumeric(ws.message, messageBits);
+		size_t maxBits = messageBits.Size();
 
 		//How much bits we skip before message
 		size_t addrBitSkip = (addrFrameNum * CW_MSG_SIZE_BITS * CW_PER_FRAMES) + CW_MSG_SIZE_BITS;
@@ -605,72 +744,213 @@ namespace POCSAG
 		if (batchCount > m_maxBatches)
 			throw std::runtime_error("Message is too long, batch count exceeded.");
 
-		output.clear();
-		for (int i = 0; i < PREAMBLE_SIZE_BYTES; i++)
-			output.push_back(PREAMBLE_SEQUENCE);
-
-
+		auto& slots = ws.slots;
+		slots.clear();
 
 		bool addrIsSet = false;
 		size_t offset = 0;
-		//Batch enum
+		//Batch enum, sync codewords are added by WriteRaw()
 		for (size_t i = 0; i < batchCount; i++)
 		{
-			insert32bit(output, SYNC_CODEWORD); //Must be at the begining of every batch
-
 			//Frame enum
 			//Each frame consists of 2 codewords, 32 bit each
 			for (size_t j = 0; j < FRAMES_PER_BATCH; j++)
 			{
-				bool addrFrame = false;
 				if (!addrIsSet && j != addrFrameNum) //Skip frames untill address
 				{
 					for (size_t k = 0; k < CW_PER_FRAMES; k++)
-						insert32bit(output, IDLE_CODEWORD); //Idle codeword means empty codeword part of frame
+						slots.push_back(IDLE_CODEWORD); //Idle codeword means empty codeword part of frame
 					continue;
 				}
 				else if (!addrIsSet) //Set address and begin set message codewords
 				{
-					insert32bit(output, MakeAddressCodeword(addr, func));
+					slots.push_back(MakeAddressCodeword(addr, page.func));
 
-					if (msgType == Type::Numeric)
-						insert32bit(output, MakeMessageCodeword(messageBitsN, offset, maxBits));
-					else if (msgType == Type::Alphanumeric)
-						insert32bit(output, MakeMessageCodeword(messageBitsA, offset, maxBits));
+					if (msgType != Type::Tone)
+						slots.push_back(MakeMessageCodeword(messageBits, offset, (uint32_t)charSize));
 					else
-						insert32bit(output, IDLE_CODEWORD);
+						slots.push_back(IDLE_CODEWORD);
 
 					addrIsSet = true;
-					addrFrame = true;
-
 					continue;
 				}
 
-				else if (msgType == Type::Numeric)
+				else if (msgType != Type::Tone)
 				{
 					for (size_t k = 0; k < CW_PER_FRAMES; k++)
-						insert32bit(output, MakeMessageCodeword(messageBitsN, offset, maxBits));
+						slots.push_back(MakeMessageCodeword(messageBits, offset, (uint32_t)charSize));
 				}
-				else if (msgType == Type::Alphanumeric)
+				else //Tone messages have no content
 				{
 					for (size_t k = 0; k < CW_PER_FRAMES; k++)
-						insert32bit(output, MakeMessageCodeword(messageBitsA, offset, maxBits));
+						slots.push_back(IDLE_CODEWORD);
 				}
-				else //Tone messages have no content
+			}
+		}
+
+		return _finishPrepare(ws, bps, format);
+	}
+
+	size_t Encoder::prepare(Workspace_t& ws, const std::vector<Page>& pages, BPS bps, Output format, TransmissionStats* stats) const
+	{
+		ws.prepared = false;
+		if (pages.empty())
+			throw std::runtime_error("No pages to encode.");
+
+		//Prepare codewords of every page and group pages by their address frame keeping original order inside of group
+		auto& pageCWs = ws.pageCodewords;
+		auto& pageBegin = ws.pageBegin;
+		auto& frameQueues = ws.frameQueues;
+		pageCWs.clear();
+		pageBegin.clear();
+		for (auto& queue : frameQueues)
+			queue.clear();
+
+		for (size_t i = 0; i < pages.size(); i++)
+		{
+			const auto& page = pages[i];
+			if (page.address > ADDR_MAX)
+				throw std::runtime_error("Address value is too big.");
+
+			_prepareMessage(page.type, page.message, page.charset, ws.message);
+			if (!ValidateMessage(ws.message, page.type))
+				throw std::runtime_error("Message is invalid.");
+
+			pageBegin.push_back(pageCWs.size());
+			AppendPageCodewords(pageCWs, ws.bits, ws.message, page.type);
+			size_t frameNum = page.address & 0b111;
+			if ((frameNum * CW_PER_FRAMES) + 1 + (pageCWs.size() - pageBegin[i]) > m_maxBatches * CW_PER_BATCH)
+				throw std::runtime_error("Message is too long, batch count exceeded.");
+
+			frameQueues[frameNum].push_back(i);
+		}
+		pageBegin.push_back(pageCWs.size());
+
+		//Codewords of all batches without sync codewords. Position inside of batch is index % CW_PER_BATCH.
+		auto& slots = ws.slots;
+		slots.clear();
+		size_t queueHeads[FRAMES_PER_BATCH] = {};
+		size_t idleCount = 0;
+
+		for (size_t placed = 0; placed < pages.size(); placed++)
+		{
+			//Pick page which address frame is the nearest to the current position. Address can take any codeword of it's frame.
+			size_t pos = slots.size() % CW_PER_BATCH;
+			size_t bestFrame = FRAMES_PER_BATCH, bestSkip = CW_PER_BATCH;
+			for (size_t f = 0; f < FRAMES_PER_BATCH; f++)
+			{
+				if (queueHeads[f] >= frameQueues[f].size())
+					continue;
+
+				size_t frameBegin = f * CW_PER_FRAMES;
+				size_t skip = 0;
+				if (pos > frameBegin + CW_PER_FRAMES - 1)
+					skip = CW_PER_BATCH - pos + frameBegin;
+				else if (pos < frameBegin)
+					skip = frameBegin - pos;
+
+				if (skip < bestSkip)
 				{
-					for (size_t k = 0; k < CW_PER_FRAMES; k++)
-						insert32bit(output, IDLE_CODEWORD);
+					bestSkip = skip;
+					bestFrame = f;
 				}
 			}
+
+			size_t pageIndex = frameQueues[bestFrame][queueHeads[bestFrame]++];
+			const auto& page = pages[pageIndex];
+
+			for (size_t i = 0; i < bestSkip; i++)
+				slots.push_back(IDLE_CODEWORD); //Idle codewords until frame of address
+			idleCount += bestSkip;
+
+			slots.push_back(MakeAddressCodeword(page.address, page.func));
+			slots.insert(slots.end(), pageCWs.begin() + pageBegin[pageIndex], pageCWs.begin() + pageBegin[pageIndex + 1]);
+		}
+
+		//Otherwise trash characters could be displayed on pager at the end of the last message
+		size_t lastFrameNum = ((slots.size() - 1) % CW_PER_BATCH) / CW_PER_FRAMES;
+		size_t tail = (CW_PER_BATCH - (slots.size() % CW_PER_BATCH)) % CW_PER_BATCH;
+		if (lastFrameNum == (FRAMES_PER_BATCH - 1))
+			tail += CW_PER_BATCH;
+
+		slots.insert(slots.end(), tail, IDLE_CODEWORD);
+		idleCount += tail;
+
+		size_t size = _finishPrepare(ws, bps, format);
+		if (stats)
+		{
+			size_t rawSize = RawSize(slots.size());
+			double airtime = (format == Output::Raw)
+				? double(rawSize * 8) / double(uint16_t(bps))
+				: double(ModulatedSize(rawSize, uint16_t(bps), ws.sampleRate)) / double(ws.sampleRate);
+
+			stats->pages = pages.size();
+			stats->batches = slots.size() / CW_PER_BATCH;
+			stats->idleCodewords = idleCount;
+			stats->airtimeSec = airtime;
+			stats->pagesPerSecond = double(pages.size()) / airtime;
 		}
 
-		if (rawPOCSAG)
-			return output.size() * 8;
+		return size;
+	}
 
-		std::vector<PCMSample_t> pcmSamples;
-		_modulatePOCSAG(pcmSamples, output, uint16_t(bps));
-		size_t sampleCount = pcmSamples.size();
-		MakePCM(pcmSamples, output, m_sampleRate); //Clears output before produce PCM buffer in it
+	size_t Encoder::encodeInto(Workspace_t& ws, std::span<uint8_t> output) const
+	{
+		if (!ws.prepared || ws.sampleRate != GetSampleRate(BPS(ws.bps)) || ws.format == Output::Samples)
+			throw std::runtime_error("Transmission is not prepared for byte output.");
+		if (output.size() < ws.size)
+			throw std::runtime_error("Output buffer is too small.");
+
+		if (ws.format == Output::Raw)
+		{
+			WriteRaw(ws.slots, output.data());
+			return ws.size * 8;
+		}
+
+		ws.raw.resize(RawSize(ws.slots.size()));
+		WriteRaw(ws.slots, ws.raw.data());
+		auto pcm = reinterpret_cast<PCMSample_t*>(output.data() + WAVE_HEADER_SIZE);
+		size_t sampleCount = _modulatePOCSAG(pcm, ws.raw.data(), ws.raw.size(), ws.bps, ws.sampleRate, m_amplitude, PCMSample_t(-m_amplitude));
+		WriteWaveHeader(output.data(), sampleCount, ws.sampleRate);
 		return sampleCount;
 	}
+
+	size_t Encoder::encodeInto(Workspace_t& ws, std::span<float> output) const
+	{
+		if (!ws.prepared || ws.sampleRate != GetSampleRate(BPS(ws.bps)) || ws.format != Output::Samples)
+			throw std::runtime_error("Transmission is not prepared for float output.");
+		if (output.size() < ws.size)
+			throw std::runtime_error("Output buffer is too small.");
+
+		ws.raw.resize(RawSize(ws.slots.size()));
+		WriteRaw(ws.slots, ws.raw.data());
+		float high = float(m_amplitude) / PCM_FLOAT_SCALE;
+		return _modulatePOCSAG(output.data(), ws.raw.data(), ws.raw.size(), ws.bps, ws.sampleRate, high, -high);
+	}
+
+	size_t Encoder::encode(std::vector<uint8_t>& output, RIC addr, Type msgType, std::string msg, BPS bps, Charset charset, Function func, bool rawPOCSAG)
+	{
+		Page page{ addr, msgType, std::move(msg), charset, func };
+		output.resize(prepare(page, bps, rawPOCSAG ? Output::Raw : Output::Wave));
+		return encodeInto(std::span<uint8_t>(output));
+	}
+
+	size_t Encoder::encode(std::vector<uint8_t>& output, const std::vector<Page>& pages, BPS bps, bool rawPOCSAG, TransmissionStats* stats)
+	{
+		output.resize(prepare(pages, bps, rawPOCSAG ? Output::Raw : Output::Wave, stats));
+		return encodeInto(std::span<uint8_t>(output));
+	}
+
+	size_t Encoder::encodeSamples(FloatBuffer_t& output, RIC addr, Type msgType, std::string msg, BPS bps, Charset charset, Function func)
+	{
+		Page page{ addr, msgType, std::move(msg), charset, func };
+		output.resize(prepare(page, bps, Output::Samples));
+		return encodeInto(std::span<float>(output));
+	}
+
+	size_t Encoder::encodeSamples(FloatBuffer_t& output, const std::vector<Page>& pages, BPS bps, TransmissionStats* stats)
+	{
+		output.resize(prepare(pages, bps, Output::Samples, stats));
+		return encodeInto(std::span<float>(output));
+	}
 }
\ No newline at end of file
@@ -13,6 +13,9 @@
 
 #include <vector>
 #include <string>
+#include <span>
+
+class HackRF_Benchmark;
 
 namespace POCSAG
 {
@@ -54,31 +57,96 @@ namespace POCSAG
 		Cyrilic
 	};
 
+	//Single page of multi-page transmission
+	struct Page
+	{
+		RIC address;                        //RIC number of receiver. Value between 0 and 2097151.
+		Type type;                          //Type of message
+		std::string message;                //Message content, same rules as for single page encode()
+		Charset charset = Charset::Latin;   //Charset of alphanumeric message
+		Function func = Function::A;        //Type of notification
+	};
+
+	//Format of prepared transmission for Encoder::encodeInto()
+	enum class Output
+	{
+		Raw,     //Raw POCSAG buffer
+		Wave,    //PCM (Wave) buffer with header
+		Samples  //Normalized float samples without header
+	};
+
+	//Statistics of encoded multi-page transmission
+	struct TransmissionStats
+	{
+		size_t pages = 0;           //Count of pages in transmission
+		size_t batches = 0;         //Count of batches after preamble
+		size_t idleCodewords = 0;   //Count of idle codewords used as padding
+		double airtimeSec = 0;      //Total air time including preamble and silence (if PCM)
+		double pagesPerSecond = 0;  //Pages per second of air time
+	};
+
 	class Encoder
 	{
 	public:
 		using PCMSample_t = int16_t;	//16bit
 		using WaveBuffer_t = std::vector<uint8_t>;
+		using FloatBuffer_t = std::vector<float>;
+
+		//Buffers reused between calls. Once they have grown to the largest transmission encoding doesn't touch heap.
+		//Encoder has it's own one, const API takes workspace of calling thread.
+		struct Workspace_t
+		{
+			std::string message;                    //Message of current page after charset conversion
+			std::vector<uint64_t> bits;             //Packed message bits of current page
+			std::vector<uint32_t> pageCodewords;    //Message codewords of all pages one after another
+			std::vector<size_t> pageBegin;          //Index of the first codeword of every page in pageCodewords and end of the last one
+			std::vector<size_t> frameQueues[8];     //Pages by address frame
+			std::vector<uint32_t> slots;            //Codewords of prepared transmission without sync codewords
+			std::vector<uint8_t> raw;               //Raw POCSAG of prepared transmission, modulator input
+			Output format = Output::Raw;
+			uint16_t bps = 0;
+			uint32_t sampleRate = 0;                //Of output, GetSampleRate(bps) of encoder which prepared transmission
+			size_t size = 0;                        //Returned by prepare()
+			bool prepared = false;
+		};
 
 	private:
 		uint32_t m_sampleRate;
+		uint32_t m_samplesPerBit;
 		PCMSample_t m_amplitude;
 		size_t m_maxBatches;
 		DateTimePosition m_dateFormat;
+		Workspace_t m_ws;
+
+		friend class ::HackRF_Benchmark;
 
 		Encoder(const Encoder&) = delete;
 		Encoder& operator=(const Encoder&) = delete;
 
-		void _modulatePOCSAG(std::vector<PCMSample_t>& output, const std::vector<uint8_t>& data, uint16_t bps);
+		template<typename T>
+		size_t _modulatePOCSAG(T* output, const uint8_t* data, size_t size, uint16_t bps, uint32_t sampleRate, T high, T low) const;
+		template<typename T>
+		void _modulatePOCSAG(std::vector<T>& output, const std::vector<uint8_t>& data, uint16_t bps, T high, T low);
+		void _prepareMessage(Type msgType, const std::string& msg, Charset charset, std::string& output) const;
+		size_t _finishPrepare(Workspace_t& ws, BPS bps, Output format) const;
 
 	public:
-		Encoder(size_t maxBatches = 8, uint32_t sampleRate = 44100); //This sampling rate is pretty much OK
+		Encoder(size_t maxBatches = 8, uint32_t sampleRate = 44100, uint32_t samplesPerBit = 0); //This sampling rate is pretty much OK
 		~Encoder();
 
 		//Sampling rate of modulated signal
 		uint32_t GetSampleRate() const;
 		void SetSampleRate(uint32_t sampleRate);
 
+		//Minimum sample rate mode. If samplesPerBit is not 0, signal is modulated at the lowest rate which gives exactly
+		//samplesPerBit samples per bit: bps * samplesPerBit (9600 Hz for 2400 bps and 4 samples per bit), instead of GetSampleRate().
+		//Output is many times smaller and cheaper to resample. 0 turns it off, it is off by default.
+		uint32_t GetSamplesPerBit() const;
+		void SetSamplesPerBit(uint32_t samplesPerBit);
+
+		//Sampling rate of signal modulated with given bps. The same as GetSampleRate() unless minimum sample rate mode is on.
+		uint32_t GetSampleRate(BPS bps) const;
+
 		//Amplitude (or volume) of modulated signal
 		PCMSample_t GetAmplitude() const;
 		void SetAmplitude(uint32_t sampleRate);
@@ -101,5 +169,42 @@ namespace POCSAG
 		//							   This buffer is just raw buffer of encoded message. This argument is false by default.
 		// Returns: If rawPOCSAG true returns size in bits of encoded pocsag message. If rawPOCSAG false return total count of PCM samples.
 		size_t encode(std::vector<uint8_t>& output, RIC address, Type msgType, std::string msg, BPS bps, Charset charset = Charset::Latin, Function func = Function::A, bool rawPOCSAG = false);
+
+		// Encodes many pages into single POCSAG transmission with one preamble and one pair of silence gaps.
+		// Each address is placed into it's own frame (last 3 bits of RIC) and pages are reordered to minimize idle codewords.
+		// Takes:
+		//  output    [out]           - You must specify your output buffer.
+		//  pages     [in]            - List of pages. All of them are sent with the same bps. Can't be empty.
+		//  bps       [in]            - Bits per second for POCSAG transmission. Can be 512, 1200 or 2400.
+		//  rawPOCSAG [in, optional]  - Same as for single page encode().
+		//  stats     [out, optional] - Receives statistics of transmission: batches, idle codewords, air time and pages per second.
+		// Returns: Same as single page encode().
+		size_t encode(std::vector<uint8_t>& output, const std::vector<Page>& pages, BPS bps, bool rawPOCSAG = false, TransmissionStats* stats = nullptr);
+
+		// Same as encode() with rawPOCSAG false, but produces normalized float samples without WAV header.
+		// This buffer can be moved directly into HackRF_PCMSource, so no serialization and parsing of PCM is needed.
+		// Sample rate of this buffer is GetSampleRate(bps). Returns total count of samples.
+		size_t encodeSamples(FloatBuffer_t& output, RIC address, Type msgType, std::string msg, BPS bps, Charset charset = Charset::Latin, Function func = Function::A);
+		size_t encodeSamples(FloatBuffer_t& output, const std::vector<Page>& pages, BPS bps, TransmissionStats* stats = nullptr);
+
+		// Two step encoding into caller's buffer for hot paths. prepare() lays out transmission in encoder's workspace and
+		// returns exact size of output: bytes for Output::Raw and Output::Wave, samples for Output::Samples.
+		// Single page is laid out the same way as by single page encode(), many pages as by multi-page encode().
+		// Stats are the same as of encode() or encodeSamples() with the same format.
+		size_t prepare(const Page& page, BPS bps, Output format);
+		size_t prepare(const std::vector<Page>& pages, BPS bps, Output format, TransmissionStats* stats = nullptr);
+
+		// Writes transmission of the last prepare() into output which must be at least of prepared size.
+		// Byte span is for Output::Raw and Output::Wave, float span for Output::Samples. Throws if they don't match.
+		// Returns the same as encode() and encodeSamples(). Doesn't allocate after workspace has grown.
+		size_t encodeInto(std::span<uint8_t> output);
+		size_t encodeInto(std::span<float> output);
+
+		// Same as above, but with caller's workspace. This is stateless core of encoder: it only reads settings, so one encoder
+		// can be shared by any number of threads while nobody changes them. Every thread must have it's own workspace.
+		size_t prepare(Workspace_t& ws, const Page& page, BPS bps, Output format) const;
+		size_t prepare(Workspace_t& ws, const std::vector<Page>& pages, BPS bps, Output format, TransmissionStats* stats = nullptr) const;
+		size_t encodeInto(Workspace_t& ws, std::span<uint8_t> output) const;
+		size_t encodeInto(Workspace_t& ws, std::span<float> output) const;
 	};
 }
\ No newline at end of file
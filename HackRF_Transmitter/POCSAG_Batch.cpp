@@ -0,0 +1,192 @@
+/*
+*  Subject: POCSAG::BatchEncoder
+*  Purpose: Encodes many POCSAG transmissions at once on a pool of threads sharing one encoder.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "POCSAG_Batch.h"
+#include <atomic>
+#include <stdexcept>
+#include <algorithm>
+
+namespace POCSAG
+{
+	//Range of transmissions not taken yet, begin in high half and end in low half, so owner and thieves agree by single CAS
+	static inline uint64_t packRange(uint32_t begin, uint32_t end)
+	{
+		return (uint64_t(begin) << 32) | end;
+	}
+
+	static inline uint32_t rangeBegin(uint64_t range)
+	{
+		return uint32_t(range >> 32);
+	}
+
+	static inline uint32_t rangeEnd(uint64_t range)
+	{
+		return uint32_t(range);
+	}
+
+	struct alignas(64) BatchEncoder::Worker_t
+	{
+		std::atomic<uint64_t> range{ 0 };
+		Encoder::Workspace_t ws;
+	};
+
+	BatchEncoder::BatchEncoder(const Encoder& encoder, size_t threads)
+		: m_encoder(encoder)
+		, m_generation(0)
+		, m_running(0)
+		, m_stop(false)
+		, m_input(nullptr)
+		, m_output(nullptr)
+		, m_format(Output::Raw)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+
+		for (size_t i = 0; i < threads; i++)
+			m_workers.push_back(std::make_unique<Worker_t>());
+		for (size_t i = 0; i < threads; i++)
+			m_threads.emplace_back(&BatchEncoder::_workerThread, this, i);
+	}
+
+	BatchEncoder::~BatchEncoder()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_startCv.notify_all();
+		for (auto& thread : m_threads)
+			thread.join();
+	}
+
+	size_t BatchEncoder::getThreadCount() const
+	{
+		return m_threads.size();
+	}
+
+	void BatchEncoder::encode(const std::vector<Transmission>& transmissions, Output format, std::vector<EncodedTransmission>& results)
+	{
+		if (transmissions.size() >= UINT32_MAX)
+			throw std::runtime_error("Too many transmissions in one batch.");
+
+		std::lock_guard<std::mutex> encodeLock(m_encodeMutex);
+		results.resize(transmissions.size());
+		if (transmissions.empty())
+			return;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_input = &transmissions;
+		m_output = &results;
+		m_format = format;
+
+		//Equal ranges in order, so without stealing every thread goes through neighbouring transmissions
+		const uint64_t count = transmissions.size(), workers = m_workers.size();
+		for (uint64_t i = 0; i < workers; i++)
+			m_workers[i]->range.store(packRange(uint32_t(i * count / workers), uint32_t((i + 1) * count / workers)), std::memory_order_relaxed);
+
+		m_running = m_workers.size();
+		m_generation++;
+		m_startCv.notify_all();
+		m_doneCv.wait(lock, [this]() { return m_running == 0; });
+
+		m_input = nullptr;
+		m_output = nullptr;
+	}
+
+	bool BatchEncoder::_take(size_t index, size_t& item)
+	{
+		//Own range from the front
+		auto& own = m_workers[index]->range;
+		uint64_t range = own.load(std::memory_order_acquire);
+		while (rangeBegin(range) < rangeEnd(range))
+		{
+			if (own.compare_exchange_weak(range, packRange(rangeBegin(range) + 1, rangeEnd(range)), std::memory_order_acq_rel))
+			{
+				item = rangeBegin(range);
+				return true;
+			}
+		}
+
+		//Back half of another range. It becomes own range, nobody else writes into empty range.
+		for (size_t k = 1; k < m_workers.size(); k++)
+		{
+			auto& victim = m_workers[(index + k) % m_workers.size()]->range;
+			range = victim.load(std::memory_order_acquire);
+			while (rangeBegin(range) < rangeEnd(range))
+			{
+				uint32_t begin = rangeBegin(range), end = rangeEnd(range);
+				uint32_t half = (end - begin + 1) / 2;
+				if (victim.compare_exchange_weak(range, packRange(begin, end - half), std::memory_order_acq_rel))
+				{
+					item = end - half;
+					own.store(packRange(end - half + 1, end), std::memory_order_release);
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	void BatchEncoder::_encode(Encoder::Workspace_t& ws, size_t item)
+	{
+		const Transmission& tx = (*m_input)[item];
+		EncodedTransmission& out = (*m_output)[item];
+		out.error.clear();
+		out.stats = TransmissionStats();
+		out.result = 0;
+
+		try
+		{
+			size_t size = m_encoder.prepare(ws, tx.pages, tx.bps, m_format, &out.stats);
+			if (m_format == Output::Samples)
+			{
+				out.bytes.clear();
+				out.samples.resize(size);
+				out.result = m_encoder.encodeInto(ws, std::span<float>(out.samples));
+			}
+			else
+			{
+				out.samples.clear();
+				out.bytes.resize(size);
+				out.result = m_encoder.encodeInto(ws, std::span<uint8_t>(out.bytes));
+			}
+		}
+		catch (const std::exception& ex)
+		{
+			out.error = ex.what();
+			out.bytes.clear();
+			out.samples.clear();
+		}
+	}
+
+	void BatchEncoder::_workerThread(size_t index)
+	{
+		uint64_t generation = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_startCv.wait(lock, [&]() { return m_stop || m_generation != generation; });
+				if (m_stop)
+					return;
+				generation = m_generation;
+			}
+
+			size_t item;
+			while (_take(index, item))
+				_encode(m_workers[index]->ws, item);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_running == 0)
+				m_doneCv.notify_all();
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+*  Subject: POCSAG::BatchEncoder
+*  Purpose: Encodes many POCSAG transmissions at once on a pool of threads sharing one encoder.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "POCSAG.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+namespace POCSAG
+{
+	//Single transmission of batch, encoded like multi-page encode()
+	struct Transmission
+	{
+		std::vector<Page> pages;
+		BPS bps = BPS::BPS_1200;
+	};
+
+	//Only buffer of requested format is filled, the other one is empty
+	struct EncodedTransmission
+	{
+		std::vector<uint8_t> bytes;       //Output::Raw and Output::Wave
+		Encoder::FloatBuffer_t samples;   //Output::Samples
+		size_t result = 0;                //Same as returned by encode() or encodeSamples()
+		TransmissionStats stats;
+		std::string error;                //Not empty if transmission can't be encoded
+	};
+
+	//Every thread starts with equal range of transmissions and steals half of another thread's range when it's own is over.
+	//Result of every transmission goes to the same index as it's request, so results don't depend on thread count or timing.
+	//Encoder is used through it's const API and must outlive this object, it's settings must not be changed during encode().
+	class BatchEncoder
+	{
+	private:
+		struct Worker_t;
+
+		const Encoder& m_encoder;
+		std::vector<std::unique_ptr<Worker_t>> m_workers;
+		std::vector<std::thread> m_threads;
+		std::mutex m_encodeMutex; //One batch at a time
+		std::mutex m_mutex;
+		std::condition_variable m_startCv;
+		std::condition_variable m_doneCv;
+		uint64_t m_generation;
+		size_t m_running;
+		bool m_stop;
+
+		const std::vector<Transmission>* m_input;
+		std::vector<EncodedTransmission>* m_output;
+		Output m_format;
+
+		BatchEncoder(const BatchEncoder&) = delete;
+		BatchEncoder& operator=(const BatchEncoder&) = delete;
+
+		void _workerThread(size_t index);
+		bool _take(size_t index, size_t& item);
+		void _encode(Encoder::Workspace_t& ws, size_t item);
+
+	public:
+		BatchEncoder(const Encoder& encoder, size_t threads = 0); //0 means one thread per CPU thread
+		~BatchEncoder();
+
+		size_t getThreadCount() const;
+
+		// Encodes all transmissions and returns when they are done. results is resized to count of transmissions,
+		// buffers of it's items are reused, so keep it between calls to avoid allocations.
+		void encode(const std::vector<Transmission>& transmissions, Output format, std::vector<EncodedTransmission>& results);
+	};
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+/*
+*  Subject: POCSAG::Encoder internals
+*  Purpose: Encoder stages which are not a part of public API. Used by Benchmark project.
+*  Author: Goshante (http://github.com/goshante)
+*  Year: 2023
+*  Original project: https://github.com/goshante/pocsag-hackrf-tx
+*
+*  Comment: Free to use if you credit me in your project.
+*/
+
+#include "POCSAG.h"
+
+namespace POCSAG
+{
+	std::string encodeString7bit(const std::string& input, Charset charset);
+	void MakePCM(const std::vector<Encoder::PCMSample_t>& samples, std::vector<uint8_t>& wave, uint32_t sampleRate);
+	uint32_t SignFrame(uint32_t in);
+	uint32_t MakeAddressCodeword(RIC addr, Function func);
+	void MakePageCodewords(std::vector<uint32_t>& cws, const std::string& msg, Type msgType); //Uses MakeMessageCodeword
+}
@@ -9,17 +9,18 @@ int main()
 	try
 	{
 		POCSAG::Encoder pocsag;
-		std::vector<uint8_t> message;
+		std::vector<float> message;
 		pocsag.SetAmplitude(8000); //PCM Sample amplitude. POCSAG PCMs always 16bit.
 		pocsag.SetDateTimePosition(POCSAG::DateTimePosition::Begin); //Append date/time to begin of the message
 
 		//Make alphanumeric message for pager with RIC 1234567, 512 bitrate and encode text as latin
-		pocsag.encode(message, 1234567, POCSAG::Type::Alphanumeric, "Test message. Hello world!", POCSAG::BPS::BPS_512, POCSAG::Charset::Latin);
+		//encodeSamples() produces float samples ready for TX. Use encode() if you need WAV buffer instead.
+		pocsag.encodeSamples(message, 1234567, POCSAG::Type::Alphanumeric, "Test message. Hello world!", POCSAG::BPS::BPS_512, POCSAG::Charset::Latin);
 
 		//Prepare message PCM data for TX
 		//You can make HackRF_PCMSource() from any PCM data. It supports only PCM raw format. 8, 16, 24 and 32 bits.
 		//Mono or stereo. If you use stereo it will be re-sampled to mono.
-		HackRF_PCMSource pcm(message);
+		HackRF_PCMSource pcm(std::move(message), pocsag.GetSampleRate(POCSAG::BPS::BPS_512));
 		HackRFTransmitter tx;
 		tx.PushSamples(pcm); //Push new pack of samples. This pack is called "chunk"
 		tx.SetSubChunkSizeSamples(4096); //Each chunk is splitted on subchunks, 4096 samples each